@@ -0,0 +1,309 @@
+/**
+ * Program name : qcal_bench.cpp
+ * Date of program : 2026/10/14
+ * Author : tomo-ing
+ */
+
+/**
+ * 量子回路計算エンジン ベンチマーク (qcal_bench.cpp)
+ *
+ * qcal.cpp を同じ翻訳単位に取り込み、合成回路で sumDoubleArray を実行して
+ * 処理時間を計測します。ネイティブ（g++/clang++）と Node.js 上のWebAssembly（em++）の
+ * どちらでも同じソースでビルドでき、結果をJSONで標準出力に出力します
+ * （バージョン間の比較は出力JSONの差分で行います）。
+ *
+ * 回路の種類：
+ * - random : 全量子ビットにランダムな1量子ビットゲートを並べた層
+ * - ladder : H層の後に隣接量子ビット間のCNOTを1段ずつ並べた梯子
+ * - theavy : H/T を主体とした変換済み回路相当のゲート列
+ * - trace  : ゲートなし（初期化と密度行列計算のみ、ブロッホ球表示だけの更新に相当）
+ *
+ * 出力項目（1ケースごと）：
+ * - call_ms         : sumDoubleArray 1回（初期化・ゲート演算・密度行列計算）の中央値
+ * - gates_per_sec   : 回路のゲート数 / call_ms
+ * - state_gb_per_sec: ゲート演算で読み書きした振幅のバイト数 / call_ms（実効帯域）
+ * - initialize_ms   : initialize の中央値（--single / --split で選んだ精度・レイアウト）
+ * - trace_ms        : calculateTraceState の中央値（同上）
+ *
+ * ビルド方法（リポジトリ直下で実行）:
+ *   g++ -std=c++17 -O3 -march=native -pthread bench/qcal_bench.cpp -o qcal_bench
+ *   em++ -std=c++17 -O3 -msimd128 -pthread -s ENVIRONMENT=node -s INITIAL_MEMORY=1073741824 \
+ *        -s PTHREAD_POOL_SIZE=8 bench/qcal_bench.cpp -o qcal_bench.js
+ *
+ * 実行例:
+ *   ./qcal_bench --min 4 --max 22 --rows 20 --repeat 5 > bench.json
+ *   node qcal_bench.js --shapes random,trace --single --split > bench-wasm.json
+ */
+
+#include "../static/cpp/qcal.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+
+/**
+ * @brief 1ケース分の計測設定
+ */
+struct BenchCase {
+    string shape;  // 回路の種類
+    int numQubits; // 量子ビット数
+    int rows;      // 回路の行数
+};
+
+/**
+ * @brief コマンドライン引数で指定する計測条件
+ */
+struct BenchOptions {
+    int minQubits = 4;                            // 最小量子ビット数
+    int maxQubits = 21;                           // 最大量子ビット数
+    int stepQubits = 2;                           // 量子ビット数の刻み
+    int rows = 20;                                // 回路の行数
+    int repeat = 5;                               // 1ケース当たりの計測回数（中央値を出力）
+    int threads = 0;                              // 計算スレッド数（0 = 論理コア数）
+    bool singlePrecision = false;                 // 単精度モード（boolShared ビット4）
+    bool splitLayout = false;                     // SoAレイアウト（boolShared ビット5）
+    bool clusterMode = false;                     // クラスタモード（boolShared ビット6）
+    vector<string> shapes = {"random", "ladder", "theavy", "trace"}; // 計測する回路の種類
+};
+
+// ゲートID（funcqcal.js の charToNumber と同じ、ASCIIコード）
+const int GATE_X = 120, GATE_Y = 121, GATE_Z = 122, GATE_S = 115, GATE_T = 116, GATE_H = 104;
+const int CONTROL_CODE = 99110; // コントロールビット
+
+/**
+ * @brief 合成回路のゲート配置データ（行ごとに numQubits 要素）を作成する
+ */
+vector<int> buildCircuit(const BenchCase& bench, mt19937& random){
+    const int n = bench.numQubits;
+    vector<int> circuit(static_cast<size_t>(n) * bench.rows, 0);
+    const int single[] = {GATE_X, GATE_Y, GATE_Z, GATE_S, GATE_T, GATE_H};
+    for (int row = 0; row < bench.rows; ++row){
+        int* cells = circuit.data() + static_cast<size_t>(row) * n;
+        if (bench.shape == "random"){
+            for (int q = 0; q < n; ++q){
+                cells[q] = single[random() % 6];
+            }
+        }else if (bench.shape == "ladder"){
+            if (row % n == 0){
+                fill(cells, cells + n, GATE_H);
+            }else{
+                int control = (row % n) - 1;
+                cells[control] = CONTROL_CODE;
+                cells[control + 1] = GATE_X;
+            }
+        }else if (bench.shape == "theavy"){
+            // 変換済み回路の典型的な並び（H T H T ... の間にS）
+            const int pattern[] = {GATE_H, GATE_T, GATE_H, GATE_T, GATE_T, GATE_S};
+            for (int q = 0; q < n; ++q){
+                cells[q] = pattern[(row + q) % 6];
+            }
+        }
+    }
+    return circuit;
+}
+
+/**
+ * @brief ゲート配置データから演算リストを作成する（funcqcal.js の generateCircuitOps と同じ並び）
+ */
+vector<int> buildCircuitOps(const vector<int>& circuit, int numQubits){
+    const int rows = static_cast<int>(circuit.size()) / numQubits;
+    const int gateIndex[] = {GATE_X, GATE_Y, GATE_Z, GATE_S, GATE_T, GATE_H};
+    vector<int> rowStart = {0};
+    vector<int> ops;
+    for (int row = 0; row < rows; ++row){
+        const int* cells = circuit.data() + static_cast<size_t>(row) * numQubits;
+        int controlOnes = 0;
+        for (int q = 0; q < numQubits; ++q){
+            if (cells[q] == CONTROL_CODE){
+                controlOnes |= 1 << q;
+            }
+        }
+        for (int q = numQubits - 1; q >= 0; --q){
+            if (cells[q] != 0 && cells[q] != CONTROL_CODE){
+                int index = static_cast<int>(find(gateIndex, gateIndex + 6, cells[q]) - gateIndex);
+                ops.insert(ops.end(), {q, index, controlOnes, 0});
+            }
+        }
+        rowStart.push_back(static_cast<int>(ops.size()) / CIRCUIT_OP_SIZE);
+    }
+    vector<int> result = {rows};
+    result.insert(result.end(), rowStart.begin(), rowStart.end());
+    result.insert(result.end(), ops.begin(), ops.end());
+    return result;
+}
+
+/**
+ * @brief 演算リストのゲート演算で読み書きする振幅のバイト数（制御ビットで絞られたペアのみ）
+ */
+double sweptBytes(const vector<int>& circuitOps, int numQubits, size_t amplitudeBytes){
+    const int rows = circuitOps[0];
+    const int* ops = circuitOps.data() + 2 + rows;
+    double bytes = 0.0;
+    for (int k = 0; k < circuitOps[1 + rows]; ++k){
+        int controls = __builtin_popcount(static_cast<uint32_t>(ops[CIRCUIT_OP_SIZE * k + 2]));
+        double pairs = ldexp(1.0, numQubits - 1 - controls);
+        bytes += pairs * 2 * amplitudeBytes * 2; // 2振幅 × 読み込み・書き込み
+    }
+    return bytes;
+}
+
+/**
+ * @brief 計測値の中央値
+ */
+double median(vector<double> values){
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+/**
+ * @brief 1ケースを計測してJSONオブジェクトを出力する
+ */
+void runCase(const BenchCase& bench, const BenchOptions& options, mt19937& random, bool first){
+    const int n = bench.numQubits;
+    vector<int> circuit = buildCircuit(bench, random);
+    vector<int> circuitOps = buildCircuitOps(circuit, n);
+    int gates = circuitOps[1 + circuitOps[0]];
+
+    // sumDoubleArray の引数（funcqcal.js の arenaByteLengths と同じ構成）
+    size_t stateLength = static_cast<size_t>(2) << n;
+    vector<double> state(stateLength), slider(2 * n), result(9 * n), stateParams(4), gatePacks(48), densityMatrix(8 * n);
+    vector<int> gateIds(6), gateKinds(6);
+    for (int q = 0; q < n; ++q){
+        slider[2 * q] = random() % 180;     // θ（度単位、calculateQubitState と同じ）
+        slider[2 * q + 1] = random() % 360; // φ（度単位）
+    }
+    int lengthint = static_cast<int>(circuit.size()), numQubits = n, cutint = 0, progress = 0;
+    double timeBudget = 0.0;
+    uint64_t modeFlags = (options.singlePrecision ? 1ULL << 4 : 0) | (options.splitLayout ? 1ULL << 5 : 0) |
+                         (options.clusterMode ? 1ULL << 6 : 0);
+
+    // --single / --split で選んだ精度・レイアウトの状態ベクトル（sumDoubleArray と同じ配置）
+    size_t amplitudes = static_cast<size_t>(1) << n;
+    float* singleState = reinterpret_cast<float*>(state.data());
+    auto withState = [&](auto process){
+        if (options.splitLayout){
+            if (options.singlePrecision){
+                process(SplitState<float>{singleState, singleState + amplitudes});
+            }else{
+                process(SplitState<double>{state.data(), state.data() + amplitudes});
+            }
+        }else if (options.singlePrecision){
+            process(singleState);
+        }else{
+            process(state.data());
+        }
+    };
+
+    vector<double> callTimes, initializeTimes, traceTimes;
+    for (int r = 0; r < options.repeat; ++r){
+        uint64_t flags = (1ULL << 1) | modeFlags; // 毎回初期化から実行
+        progress = 0;
+        double start = emscripten_get_now();
+        sumDoubleArray(slider.data(), circuit.data(), &lengthint, &numQubits, &cutint, result.data(), &progress, &flags,
+                       state.data(), stateParams.data(), gatePacks.data(), gateIds.data(), circuitOps.data(),
+                       densityMatrix.data(), gateKinds.data(), &timeBudget);
+        callTimes.push_back(emscripten_get_now() - start);
+
+        // 初期化と密度行列計算を単独で計測（選んだ精度・レイアウトの経路）
+        withState([&](auto view){
+            double phaseStart = emscripten_get_now();
+            initialize(slider.data(), n, view, stateParams.data());
+            initializeTimes.push_back(emscripten_get_now() - phaseStart);
+            phaseStart = emscripten_get_now();
+            calculateTraceState(view, n, densityMatrix.data());
+            traceTimes.push_back(emscripten_get_now() - phaseStart);
+        });
+    }
+
+    double callMs = median(callTimes);
+    size_t amplitudeBytes = options.singlePrecision ? 2 * sizeof(float) : 2 * sizeof(double);
+    double bytes = sweptBytes(circuitOps, n, amplitudeBytes);
+    printf("%s    {\"shape\": \"%s\", \"qubits\": %d, \"rows\": %d, \"gates\": %d, "
+           "\"call_ms\": %.4f, \"gates_per_sec\": %.1f, \"state_gb_per_sec\": %.3f, "
+           "\"initialize_ms\": %.4f, \"trace_ms\": %.4f}",
+           first ? "" : ",\n", bench.shape.c_str(), n, bench.rows, gates,
+           callMs, gates / (callMs * 1e-3), bytes / (callMs * 1e-3) / 1e9,
+           median(initializeTimes), median(traceTimes));
+    fflush(stdout);
+    fprintf(stderr, "%-7s %2d qubits: %.3f ms\n", bench.shape.c_str(), n, callMs);
+}
+
+/**
+ * @brief カンマ区切りの文字列を分割する
+ */
+vector<string> splitList(const string& text){
+    vector<string> items;
+    size_t begin = 0;
+    while (begin <= text.size()){
+        size_t end = text.find(',', begin);
+        if (end == string::npos){
+            end = text.size();
+        }
+        if (end > begin){
+            items.push_back(text.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return items;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        auto value = [&](){ return i + 1 < argc ? string(argv[++i]) : string(); };
+        if (arg == "--min") options.minQubits = atoi(value().c_str());
+        else if (arg == "--max") options.maxQubits = atoi(value().c_str());
+        else if (arg == "--step") options.stepQubits = max(1, atoi(value().c_str()));
+        else if (arg == "--rows") options.rows = atoi(value().c_str());
+        else if (arg == "--repeat") options.repeat = max(1, atoi(value().c_str()));
+        else if (arg == "--threads") options.threads = atoi(value().c_str());
+        else if (arg == "--shapes") options.shapes = splitList(value());
+        else if (arg == "--single") options.singlePrecision = true;
+        else if (arg == "--split") options.splitLayout = true;
+        else if (arg == "--cluster") options.clusterMode = true;
+        else {
+            fprintf(stderr, "usage: %s [--min N] [--max N] [--step N] [--rows N] [--repeat N] [--threads N]\n"
+                            "          [--shapes random,ladder,theavy,trace] [--single] [--split] [--cluster]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int threads = options.threads > 0 ? options.threads : max(1, static_cast<int>(thread::hardware_concurrency()));
+    setThreadCount(threads);
+    setCheckpointInterval(0, 0); // 同じ回路の繰り返し計測でチェックポイントから再開しないよう無効化
+
+#ifdef __EMSCRIPTEN__
+    const bool wasm = true;
+#else
+    const bool wasm = false;
+#endif
+#ifdef __wasm_simd128__
+    const bool simd = true;
+#else
+    const bool simd = false;
+#endif
+
+    printf("{\n  \"engine\": {\"wasm\": %s, \"simd128\": %s, \"threads\": %d, \"precision\": \"%s\", "
+           "\"layout\": \"%s\", \"state_mode\": \"%s\", \"repeat\": %d},\n  \"results\": [\n",
+           wasm ? "true" : "false", simd ? "true" : "false", threads,
+           options.singlePrecision ? "single" : "double", options.splitLayout ? "split" : "interleaved",
+           options.clusterMode ? "cluster" : "dense", options.repeat);
+
+    mt19937 random(12345); // 版間で同じ回路になるよう固定シード
+    bool first = true;
+    for (const string& shape : options.shapes){
+        for (int n = options.minQubits; n <= options.maxQubits; n += options.stepQubits){
+            BenchCase bench{shape, n, shape == "trace" ? 1 : options.rows};
+            runCase(bench, options, random, first);
+            first = false;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
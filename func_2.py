@@ -12,19 +12,49 @@
 - 量子ゲートの適用（制御ゲート含む）
 - 量子状態の初期化と計算
 - 部分トレース計算
+- 量子ビット対の縮約密度行列と concurrence・purity
 - ブロッホ球座標変換
 - データファイルの読み込み・フィルタリング
+- ゲートライブラリの重複除去と最近傍検索インデックス
+- 前半処理（エンタングルメント生成）の複数プロセス並列探索
 - 量子回路最適化のメイン計算処理
 - 結果の詳細分析と表示
 """
 
+import multiprocessing
+import os
+import threading
+from concurrent.futures import ProcessPoolExecutor, wait, FIRST_COMPLETED
+
 import numpy as np
 import pyjson
+import qcal_native
+
+try:
+    from scipy.spatial import cKDTree
+except ImportError:  # scipy が無い環境では最近傍検索をせず全候補を評価
+    cKDTree = None
 
 # Pauli-Xゲート（NOT ゲート）の行列表現
 X = np.array([[0, 1],
               [1, 0]])
 
+# ゲート行列の同値判定（グローバル位相除去後）に使う丸め桁数
+GATE_KEY_DECIMALS = 6
+
+# 最近傍検索で目標回転の円周（単位四元数空間）をサンプリングする点数
+INDEX_CIRCLE_SAMPLES = 64
+
+# 前半処理の並列探索に使うプロセス数（環境変数 QCAL_SEARCH_WORKERS で指定、1以下で無効）
+SEARCH_WORKERS = int(os.environ.get('QCAL_SEARCH_WORKERS', os.cpu_count() or 1))
+
+# 1プロセス当たりの分割タスク数（進捗更新・停止チェックの細かさ）
+SEARCH_TASKS_PER_WORKER = 4
+
+# 全ユーザーで共有する探索用プロセスプール（初回使用時に作成）
+_search_pool = None
+_search_pool_lock = threading.Lock()
+
 
 def data_read():
     """
@@ -233,6 +263,86 @@ def partical_trace(state, numQubit):
     return densityMatrix
 
 
+def evaluate_gate_candidates(state_vector, numQubit, targetQubit, controlQubit, candidates):
+    """
+    候補ゲート群を1量子ビットに適用した結果のブロッホ座標をまとめて計算
+    状態ベクトルを候補ごとに複製せず、縮約密度行列 ρ を1回だけ求めて U·ρ·U† で評価する
+
+    Args:
+        state_vector (numpy.ndarray): 基準の状態ベクトル（変更しない）
+        numQubit (int): 量子ビット数
+        targetQubit (int): 候補ゲートを適用する量子ビット
+        controlQubit (int): 候補ゲートの後に適用するCNOTの制御ビット（-1の場合はCNOTなし）
+        candidates (numpy.ndarray): 候補ゲート行列 [K, 2, 2]
+
+    Returns:
+        numpy.ndarray: 候補ごとのブロッホ座標 [K, 2, 3]（[:, 0]: ターゲット, [:, 1]: 制御ビット）
+    """
+    candidates = np.asarray(candidates, dtype=complex)
+    psi = np.asarray(state_vector, dtype=complex).reshape([2] * numQubit)
+    coordinates = np.zeros((len(candidates), 2, 3))
+
+    def bloch(rho):
+        # CoordinateCalc と同じ定義のブロッホ座標
+        return np.stack([2*np.real(rho[:, 1, 0]), 2*np.imag(rho[:, 1, 0]), abs(2*rho[:, 0, 0]) - 1], axis=-1)
+
+    if controlQubit == -1:
+        # 1量子ビットの縮約密度行列 ρ[a][b] = Σ ψ_a·conj(ψ_b)
+        amp = np.moveaxis(psi, targetQubit, 0).reshape(2, -1)
+        rho = amp @ amp.conj().T
+        new_rho = candidates @ rho @ np.conj(np.transpose(candidates, (0, 2, 1)))
+        coordinates[:, 0] = bloch(new_rho)
+    else:
+        # 2量子ビットの縮約密度行列（行・列番号 = 2·制御ビット + ターゲットビット）
+        amp = np.moveaxis(psi, [controlQubit, targetQubit], [0, 1]).reshape(4, -1)
+        rho = amp @ amp.conj().T
+        gate = np.einsum('ab,kcd->kacbd', np.eye(2), candidates).reshape(-1, 4, 4)  # I⊗U
+        gate = gate[:, [0, 1, 3, 2], :]  # CNOT（制御ビット=1の行を入れ替え）
+        new_rho = (gate @ rho @ np.conj(np.transpose(gate, (0, 2, 1)))).reshape(-1, 2, 2, 2, 2)
+        coordinates[:, 0] = bloch(np.einsum('kcacb->kab', new_rho))  # 制御ビットでトレース
+        coordinates[:, 1] = bloch(np.einsum('kacbc->kab', new_rho))  # ターゲットでトレース
+    return coordinates
+
+
+def pair_density_matrices(state_vector, numQubit, pairs):
+    """
+    量子ビット対ごとの縮約密度行列（4x4）と concurrence・purity を計算
+
+    Args:
+        state_vector (numpy.ndarray): 多量子ビット状態ベクトル
+        numQubit (int): 量子ビット数
+        pairs (list): 量子ビット対 [[qubit_a, qubit_b], ...]
+                      （行・列番号 = 2·qubit_aのビット + qubit_bのビット）
+
+    Returns:
+        tuple: (縮約密度行列 [P, 4, 4], concurrence [P], purity [P])
+    """
+    psi = np.asarray(state_vector, dtype=complex).reshape([2] * numQubit)
+    YY = np.kron([[0, -1j], [1j, 0]], [[0, -1j], [1j, 0]])  # σy⊗σy
+    rho = np.zeros((len(pairs), 4, 4), dtype=complex)
+    concurrence = np.zeros(len(pairs))
+    purity = np.zeros(len(pairs))
+
+    for k, (qubit_a, qubit_b) in enumerate(pairs):
+        amp = np.moveaxis(psi, [qubit_a, qubit_b], [0, 1]).reshape(4, -1)
+        rho[k] = amp @ amp.conj().T
+
+        # Wootters の concurrence：ρ·ρ̃ の固有値の平方根 λ₁ ≥ … ≥ λ₄ から max(0, λ₁−λ₂−λ₃−λ₄)
+        rho_tilde = YY @ rho[k].conj() @ YY
+        lam = np.sort(np.sqrt(np.abs(np.real(np.linalg.eigvals(rho[k] @ rho_tilde)))))[::-1]
+        concurrence[k] = max(0.0, lam[0] - lam[1] - lam[2] - lam[3])
+        purity[k] = np.real(np.trace(rho[k] @ rho[k]))
+    return rho, concurrence, purity
+
+
+# ネイティブエンジン（qcal.cpp の共有ライブラリ）が利用可能な場合は同じ引数の実装に置き換え
+if qcal_native.available():
+    apply_controlled_gate = qcal_native.apply_controlled_gate
+    partical_trace = qcal_native.partical_trace
+    evaluate_gate_candidates = qcal_native.evaluate_gate_candidates
+    pair_density_matrices = qcal_native.pair_density_matrices
+
+
 def CoordinateCalc(densityMatrix):
     """
     密度行列からブロッホ球座標を計算
@@ -376,6 +486,276 @@ def CreateGateArray(numQubit, targetQubit, controlQubit):
         gate[controlQubit] = "c"  # 制御ビット
     gate[targetQubit] = "TG"      # ターゲットビット
     return gate
+
+
+def canonical_gate_key(matrix):
+    """
+    ゲート行列のグローバル位相を除去して丸めた同値類キーを作成
+    最初の非ゼロ要素が正の実数になるよう位相をそろえる
+
+    Args:
+        matrix (numpy.ndarray): 2x2ゲート行列
+
+    Returns:
+        tuple: 丸めた実部・虚部の組（同じ回転を表す行列は同じキーになる）
+    """
+    elements = np.asarray(matrix, dtype=complex).flatten()
+    pivot = elements[0] if abs(elements[0]) > 10**-GATE_KEY_DECIMALS else elements[1]
+    elements = elements * (abs(pivot) / pivot)
+    return tuple(np.round(np.concatenate([elements.real, elements.imag]), GATE_KEY_DECIMALS) + 0.0)
+
+
+def dedupe_gate_data(gate_data):
+    """
+    グローバル位相のみ異なるゲート系列を除去（各同値類で最初の系列を残す）
+    ゲート長でソート済みのデータを渡すと最短の系列が残る
+
+    Args:
+        gate_data (list): ゲート系列データ [[gate_sequence, matrix], ...]
+
+    Returns:
+        list: 重複除去後のデータ
+    """
+    result_data = []
+    keys = set()
+    for data in gate_data:
+        key = canonical_gate_key(data[1])
+        if key not in keys:
+            keys.add(key)
+            result_data.append(data)
+    print(f"重複除去: {len(gate_data)} -> {len(result_data)}")
+    return result_data
+
+
+def gate_quaternion(matrices):
+    """
+    ゲート行列を単位四元数 (Re α, Im α, Re β, Im β) に変換
+    U/√det(U) = [[α, β], [-β*, α*]] とし、符号（±q）は区別しない
+
+    Args:
+        matrices (numpy.ndarray): ゲート行列 [K, 2, 2]
+
+    Returns:
+        numpy.ndarray: 単位四元数 [K, 4]
+    """
+    special = matrices / np.sqrt(np.linalg.det(matrices))[:, None, None]
+    return np.stack([special[:, 0, 0].real, special[:, 0, 0].imag,
+                     special[:, 0, 1].real, special[:, 0, 1].imag], axis=-1)
+
+
+def build_gate_index(gate_data):
+    """
+    ゲート系列データの最近傍検索インデックスを作成
+
+    Args:
+        gate_data (list): ゲート系列データ [[gate_sequence, matrix], ...]
+
+    Returns:
+        dict: 'matrices': ゲート行列 [K, 2, 2], 'quaternions': 単位四元数 [K, 4],
+              'tree': 四元数のkd木（scipy が無い場合はNone）
+    """
+    matrices = np.array([data[1] for data in gate_data], dtype=complex)
+    quaternions = gate_quaternion(matrices)
+    tree = cKDTree(quaternions) if cKDTree is not None and len(gate_data) != 0 else None
+    return {'matrices': matrices, 'quaternions': quaternions, 'tree': tree}
+
+
+def rotation_form(coordinate, target_coordinate):
+    """
+    四元数 q のゲートで coordinate 方向を回転したときの目標方向との内積 t·R(q)r を
+    二次形式 qᵀMq として表す4x4対称行列 M を計算（M² = I、固有値は +1, +1, -1, -1）
+
+    Args:
+        coordinate (numpy.ndarray): 回転前のブロッホ単位ベクトル r
+        target_coordinate (numpy.ndarray): 目標のブロッホ単位ベクトル t
+
+    Returns:
+        numpy.ndarray: 4x4対称行列 M
+    """
+    rho = 0.5 * np.array([[1 + coordinate[2], coordinate[0] - 1j*coordinate[1]],
+                          [coordinate[0] + 1j*coordinate[1], 1 - coordinate[2]]])
+
+    # 基底 e_i と e_i + e_j の値から二次形式の係数を復元（分極公式）
+    pairs = [(i, j) for i in range(4) for j in range(i, 4)]
+    q = np.array([np.eye(4)[i] + (np.eye(4)[j] if i != j else 0) for i, j in pairs])
+    alpha = q[:, 0] + 1j*q[:, 1]
+    beta = q[:, 2] + 1j*q[:, 3]
+    gate = np.stack([np.stack([alpha, beta], axis=-1),
+                     np.stack([-np.conj(beta), np.conj(alpha)], axis=-1)], axis=1)
+    new_rho = gate @ rho @ np.conj(np.transpose(gate, (0, 2, 1)))
+    value = (target_coordinate[0] * 2*np.real(new_rho[:, 1, 0]) + target_coordinate[1] * 2*np.imag(new_rho[:, 1, 0]) +
+             target_coordinate[2] * np.real(new_rho[:, 0, 0] - new_rho[:, 1, 1]))
+
+    form = np.zeros((4, 4))
+    for (i, j), v in zip(pairs, value):
+        form[i][j] = v
+    for i in range(4):
+        for j in range(i + 1, 4):
+            form[i][j] = form[j][i] = (form[i][j] - form[i][i] - form[j][j]) / 2
+    return form
+
+
+def query_gate_candidates(gate_index, state_vector, numQubit, qubit, target_coordinate):
+    """
+    ゲート適用後のブロッホ座標が目標座標に最も近くなり得る候補を最近傍検索で抽出
+    |R·r - t| の最小化は r 方向を t 方向へ回す四元数の円周（M の +1 固有空間）に
+    最も近い候補を探すことと等価なため、円周上のサンプル点からkd木で検索する。
+    最良候補の距離に円周サンプル間隔を加えた半径で検索するので、全件走査の最良解を必ず含む
+
+    Args:
+        gate_index (dict): build_gate_index で作成したインデックス
+        state_vector (numpy.ndarray): 現在の状態ベクトル
+        numQubit (int): 量子ビット数
+        qubit (int): ゲートを適用する量子ビット
+        target_coordinate (numpy.ndarray): 目標ブロッホ球座標
+
+    Returns:
+        numpy.ndarray: 評価すべき候補のインデックス（昇順）
+    """
+    count = len(gate_index['matrices'])
+    identity = np.eye(2, dtype=complex)[None]
+    coordinate = evaluate_gate_candidates(state_vector, numQubit, qubit, -1, identity)[0][0]
+    coordinate_norm = np.linalg.norm(coordinate)
+    target_norm = np.linalg.norm(target_coordinate)
+
+    # 回転で距離が変わらない場合（どちらかが原点）やkd木が無い場合は全候補
+    if gate_index['tree'] is None or coordinate_norm < 1e-9 or target_norm < 1e-9:
+        return np.arange(count)
+
+    form = rotation_form(coordinate / coordinate_norm, np.asarray(target_coordinate) / target_norm)
+    plane = np.linalg.eigh(form)[1][:, 2:]  # 固有値 +1 の固有空間
+
+    angles = np.linspace(0, 2*np.pi, INDEX_CIRCLE_SAMPLES, endpoint=False)
+    samples = np.outer(np.cos(angles), plane[:, 0]) + np.outer(np.sin(angles), plane[:, 1])
+
+    # 各サンプルの最近傍から最良距離の上限を求める
+    nearest = gate_index['tree'].query(samples)[1]
+    projection = np.max(np.linalg.norm(gate_index['quaternions'][nearest] @ plane, axis=1))
+    radius = np.sqrt(max(2 - 2*projection, 0)) + 2*np.sin(np.pi / INDEX_CIRCLE_SAMPLES) + 1e-9
+
+    candidates = set()
+    for found in gate_index['tree'].query_ball_point(samples, radius):
+        candidates.update(found)
+    return np.array(sorted(candidates), dtype=int)
+
+
+
+def _search_worker_initialize():
+    """
+    探索用ワーカープロセスの初期化
+    コアはプロセス間で分担するため、ネイティブエンジンは1スレッドで使用する
+    """
+    if qcal_native.available():
+        qcal_native.set_thread_count(1)
+
+
+def search_pool():
+    """
+    前半処理の探索用プロセスプールを取得（初回呼び出し時に作成）
+
+    Returns:
+        ProcessPoolExecutor or None: プロセスプール（SEARCH_WORKERS が1以下の場合はNone）
+    """
+    global _search_pool
+    with _search_pool_lock:
+        if _search_pool is None and SEARCH_WORKERS > 1:
+            # Flask/SocketIO のスレッド状態を引き継がないよう spawn で起動
+            _search_pool = ProcessPoolExecutor(max_workers=SEARCH_WORKERS,
+                                               mp_context=multiprocessing.get_context('spawn'),
+                                               initializer=_search_worker_initialize)
+    return _search_pool
+
+
+def search_entangle_gates(state, numQubit, order, matrices, begin, end):
+    """
+    前半処理の1区間分の探索（第1ゲート候補 begin〜end-1 と全ての第2ゲート候補の組み合わせ）
+    プロセスプールのワーカーで実行されるため、引数・戻り値はpickle可能な値のみ
+
+    Args:
+        state (numpy.ndarray): 探索開始時の状態ベクトル
+        numQubit (int): 量子ビット数
+        order (list): 対象量子ビットと目標半径 [[qubit_1, radius_1], [qubit_2, radius_2]]
+        matrices (numpy.ndarray): 候補ゲート行列 [K, 2, 2]
+        begin (int): 第1ゲート候補の開始インデックス
+        end (int): 第1ゲート候補の終了インデックス（含まない）
+
+    Returns:
+        tuple: (区間内の最小誤差, 第1ゲート候補インデックス, 第2ゲート候補インデックス)
+               更新が無い場合のインデックスは -1
+    """
+    min_diff = 2  # 初期最小誤差
+    best_index_1 = best_index_2 = -1
+    targetQubit_1 = order[0][0]  # 第1ターゲット量子ビット
+    targetQubit_2 = order[1][0]  # 第2ターゲット量子ビット
+    gate_1 = CreateGateArray(numQubit, targetQubit_1, -1)
+
+    for index_1 in range(begin, end):
+        # 第1ゲート適用
+        data_1_state = apply_controlled_gate(state.copy(), gate_1, matrices[index_1], numQubit)
+
+        # 第2ゲート＋CNOTゲート適用後の座標を全候補まとめて計算（エンタングルメント生成）
+        coordinates = evaluate_gate_candidates(data_1_state, numQubit, targetQubit_2, targetQubit_1, matrices)
+
+        for index_2 in range(len(matrices)):
+            # 結果評価（order[0]: 制御ビット, order[1]: ターゲット）
+            radius = [np.sqrt(sum(coordinates[index_2][1]**2)), np.sqrt(sum(coordinates[index_2][0]**2))]
+
+            # 誤差計算
+            result_diffs = []
+            for i, targetQubit in enumerate(order):
+                result_diffs.append(radiusDiff(radius[i], targetQubit[1]))
+            result_diff = (result_diffs[0] + result_diffs[1]) / 2
+
+            # 最良結果の更新
+            min_diff, min_result = diff_compare(min_diff, result_diff)
+            if min_result:
+                best_index_1 = index_1
+                best_index_2 = index_2
+    return min_diff, best_index_1, best_index_2
+
+
+def run_entangle_search(state, numQubit, order, matrices, update_progress):
+    """
+    前半処理の探索を第1ゲート候補の区間に分割して実行
+    プロセスプールが使える場合は並列に、使えない場合は1候補ずつ順に実行する
+
+    Args:
+        state (numpy.ndarray): 探索開始時の状態ベクトル
+        numQubit (int): 量子ビット数
+        order (list): 対象量子ビットと目標半径 [[qubit_1, radius_1], [qubit_2, radius_2]]
+        matrices (numpy.ndarray): 候補ゲート行列 [K, 2, 2]
+        update_progress (callable): 完了した第1ゲート候補数を受け取る進捗コールバック（Falseで停止）
+
+    Returns:
+        list or None: 区間ごとの search_entangle_gates の結果（区間順）、停止された場合はNone
+    """
+    count = len(matrices)
+    pool = search_pool()
+
+    if pool is None:
+        results = []
+        for index_1 in range(count):
+            if not update_progress(index_1):
+                return None
+            results.append(search_entangle_gates(state, numQubit, order, matrices, index_1, index_1 + 1))
+        return results
+
+    step = max(1, -(-count // (SEARCH_WORKERS * SEARCH_TASKS_PER_WORKER)))
+    futures = [pool.submit(search_entangle_gates, state, numQubit, order, matrices, begin, min(begin + step, count))
+               for begin in range(0, count, step)]
+
+    # 完了を待ちながら進捗更新・停止チェック
+    completed = 0
+    pending = set(futures)
+    while pending:
+        done, pending = wait(pending, timeout=0.1, return_when=FIRST_COMPLETED)
+        completed += len(done)
+        if not update_progress(min(completed * step, count)):
+            for future in pending:
+                future.cancel()
+            return None
+    return [future.result() for future in futures]
+
             
 def radius_inspect(sorted_data):
     """
@@ -601,7 +981,8 @@ def radius_judge(numQubit, target_radius):
     return sorted_data
 
 # メインコード
-def mainCalc(json_long, json_short, initialize_state, target_coordinates, target_radius, update_progress_callback):
+def mainCalc(json_long, json_short, initialize_state, target_coordinates, target_radius, update_progress_callback,
+             update_result_callback=None):
     """
     量子回路最適化のメイン計算処理
     2段階の最適化：前半はエンタングルメント生成、後半は個別ビット調整
@@ -613,6 +994,8 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
         target_coordinates (list): 目標ブロッホ球座標
         target_radius (list): 目標半径
         update_progress_callback (callable): 進捗更新コールバック
+        update_result_callback (callable): 途中結果のコールバック（省略可）
+                                           計算ステップごとに (確定済みのゲート系列, 最小誤差) で呼び出す
         
     Returns:
         tuple: (最適ゲート系列, 最終状態) または (エラー情報, [])
@@ -629,6 +1012,10 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
             return sorted_data, []
         calc_order = add_order(sorted_data)
     
+    # バッチ評価用の候補ゲート行列 [K, 2, 2]
+    short_matrices = np.array([data[1] for data in json_short], dtype=complex)
+    long_index = build_gate_index(json_long)  # 後半処理の最近傍検索用
+
     # 進捗計算のための定数定義
     FirstInsideStep = 3   # 前半処理の内側1ループ当たりの計算ステップ数
     FirstOutsideStep = 1  # 前半処理の外側1ループ当たりの計算ステップ数
@@ -641,7 +1028,6 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
     print("\ntotalCalcStep:", totalCalcStep, "\n")
 
     # 進捗率計算用の係数
-    FirstInsideOneProgress = (FirstInsideStep/totalCalcStep) * 100
     FirstOutsideOneProgress = ((FirstOutsideStep + len(json_short) * FirstInsideStep)/totalCalcStep) * 100
     FirstOneProgress = (FirstStep/totalCalcStep) * 100
     FirstProgress = (len(calc_order) * FirstStep/totalCalcStep) * 100
@@ -666,46 +1052,35 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
             gate_2 = CreateGateArray(numQubit, targetQubit_2, -1)        # 単一ビットゲート2
             ControlGate = CreateGateArray(numQubit, targetQubit_2, targetQubit_1)  # 制御ゲート
             
-            # 全ゲート組み合わせの試行（ブルートフォース最適化）
-            for index_1, data_1 in enumerate(json_short):
-                # 第1ゲート適用
-                data_1_state = apply_controlled_gate(result_state.copy(), gate_1, data_1[1], numQubit)
-
-                for index_2, data_2 in enumerate(json_short):
-                    # 進捗更新・停止チェック
-                    progress = (FirstOneProgress * num + FirstOutsideOneProgress * index_1 + 
-                              FirstInsideOneProgress * index_2)
-                    if not update_progress_callback(progress):
-                        return False, False
-
-                    # 第2ゲート適用
-                    data_2_state = apply_controlled_gate(data_1_state.copy(), gate_2, data_2[1], numQubit)
-                    # CNOTゲート適用（エンタングルメント生成）
-                    new_state = apply_controlled_gate(data_2_state, ControlGate, X, numQubit)
-                    
-                    # 結果評価
-                    densityMatrix = partical_trace(new_state, numQubit)
-                    radius = RadiusCalc(densityMatrix, order)
-                    
-                    # 誤差計算
-                    result_diffs = []
-                    for i, targetQubit in enumerate(order):
-                        result_diffs.append(radiusDiff(radius[i], targetQubit[1]))
-                    result_diff = (result_diffs[0] + result_diffs[1]) / 2
-                    
-                    # 最良結果の更新
-                    min_diff, min_result = diff_compare(min_diff, result_diff)
-                    if min_result:
-                        state = new_state.copy()
-                        gate_array_result_1 = [data_1[0], targetQubit_1]
-                        gate_array_result_2 = [data_2[0], targetQubit_2]
-
-            # 最良結果を次の状態として採用
-            result_state = state.copy()
+            # 全ゲート組み合わせの試行（ブルートフォース最適化、第1ゲート候補ごとに分割して並列実行）
+            def update_search_progress(index_1):
+                # 進捗更新・停止チェック
+                progress = FirstOneProgress * num + FirstOutsideOneProgress * index_1
+                return update_progress_callback(progress)
+
+            results = run_entangle_search(result_state, numQubit, order, short_matrices, update_search_progress)
+            if results is None:
+                return False, False
+
+            # 区間ごとの最良結果を候補順に比較（逐次探索と同じ優先順位）
+            for result_diff, index_1, index_2 in results:
+                min_diff, min_result = diff_compare(min_diff, result_diff)
+                if min_result:
+                    best_data_1 = json_short[index_1]
+                    best_data_2 = json_short[index_2]
+                    gate_array_result_1 = [best_data_1[0], targetQubit_1]
+                    gate_array_result_2 = [best_data_2[0], targetQubit_2]
+
+            # 最良結果の状態を再構成して次の状態として採用
+            state = apply_controlled_gate(result_state.copy(), gate_1, best_data_1[1], numQubit)
+            state = apply_controlled_gate(state, gate_2, best_data_2[1], numQubit)
+            result_state = apply_controlled_gate(state, ControlGate, X, numQubit)
             gate_array_result_3 = [["cnot"], targetQubit_2]
             gate_array.append(gate_array_result_1)
             gate_array.append(gate_array_result_2)
             gate_array.append(gate_array_result_3)
+            if update_result_callback is not None:
+                update_result_callback(list(gate_array), min_diff)
             print("前半進捗率:", (num+1)/len(calc_order)*100, "%")
         
         print("*************************\n")
@@ -717,18 +1092,22 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
     for i in range(numQubit):
         min_diff = 2  # 初期最小誤差
         gate = CreateGateArray(numQubit, i, -1)  # i番目の量子ビット用ゲート
+
+        # 目標座標に近くなり得るゲートパターンを抽出し、適用後の座標をまとめて計算
+        candidates = query_gate_candidates(long_index, result_state, numQubit, i, target_coordinates[i])
+        coordinates = evaluate_gate_candidates(result_state, numQubit, i, -1, long_index['matrices'][candidates])
         
-        # 全ゲートパターンの試行
-        for index, data in enumerate(json_long):
+        # 候補ゲートパターンの試行
+        for index, data_index in enumerate(candidates):
+            data = json_long[data_index]
+
             # 進捗更新・停止チェック
-            progress = (FirstProgress + SecondOutsideOneProgress * i) + SecondOneProgress * index
+            progress = (FirstProgress + SecondOutsideOneProgress * i) + SecondOneProgress * data_index
             if not update_progress_callback(progress):
                 return False, False
             
-            # ゲート適用と評価
-            new_state = apply_controlled_gate(result_state.copy(), gate, data[1], numQubit)
-            densityMatrix = partical_trace(new_state, numQubit)
-            new_coordinate = CoordinateCalc(densityMatrix[i])
+            # ゲート適用後の評価
+            new_coordinate = coordinates[index][0]
             
             # 目標座標との距離計算
             result_diff = distanceDiff(new_coordinate, target_coordinates[i])
@@ -736,12 +1115,14 @@ def mainCalc(json_long, json_short, initialize_state, target_coordinates, target
             # 最良結果の更新
             min_diff, min_result = diff_compare(min_diff, result_diff)
             if min_result:
-                state = new_state.copy()
+                best_data = data
                 gate_array_result = [data[0], i]
 
-        # 最良結果を次の状態として採用
-        result_state = state.copy()
+        # 最良結果の状態を再構成して次の状態として採用
+        result_state = apply_controlled_gate(result_state.copy(), gate, best_data[1], numQubit)
         gate_array.append(gate_array_result)
+        if update_result_callback is not None:
+            update_result_callback(list(gate_array), min_diff)
         print("後半進捗率:", (i+1)/numQubit*100, "%")
     
     print("*************************\n")
@@ -794,6 +1175,16 @@ def resultCalc(result_state, target_coordinates, result):
         # 結果リストに追加
         result.append(radius[0])      # 半径
         result.append(accuracy*100)   # 精度（パーセント）
+
+    # エンタングルした量子ビット（半径 < 1）の対ごとの concurrence・purity を表示
+    entangled = [i for i in range(numQubit) if RadiusCalc(densityMatrix, [[i]])[0] < 1-1e-5]
+    pairs = [[a, b] for k, a in enumerate(entangled) for b in entangled[k+1:]]
+    if len(pairs) != 0:
+        _, concurrence, purity = pair_density_matrices(result_state, numQubit, pairs)
+        for (a, b), c, p in zip(pairs, concurrence, purity):
+            print("qubit pair:", (a, b),
+                  "concurrence:", '{:.5f}'.format(c),
+                  "purity:", '{:.5f}'.format(p))
     
     return result
 
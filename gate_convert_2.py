@@ -13,11 +13,19 @@
 - 複合ゲートの基本ゲートへの分解
 - CNOTゲートの制御・ターゲット関係の処理
 - 並列実行可能な量子回路レイアウトの生成
+- 回路レイアウトのバイナリ形式（エンジンのゲートコード・演算リスト）への変換
 """
 
 import numpy as np
 import pyjson
 
+# 回路レイアウトの文字列 → エンジンのゲートコード（funcqcal.js の charToNumber と同じ値）
+ENGINE_GATE_CODES = {'X': 120, 'Y': 121, 'Z': 122, 'S': 115, 'T': 116, 'H': 104,
+                     'control': 99110, 'not-control': 99121}
+
+# バイナリ形式の版番号（先頭のワード）
+CIRCUIT_BINARY_VERSION = 2
+
 
 def gate_convert_data_read():
     """
@@ -191,3 +199,30 @@ def second_convert_gate(numQubit, first_converted_gate):
         data_list = [a + b for a, b in zip(data_list, add_data_list)]
 
     return final_result_gate
+
+
+def encode_circuit_binary(numQubit, final_result_gate):
+    """
+    回路レイアウトをバイナリ形式（リトルエンディアンのint32列）に変換する
+    フロントエンドはJSONの入れ子配列を解析せずに Int32Array として読む
+    （演算リストは回路エディタに反映した後に funcqcal.js の generateCircuitOps が作成する）
+
+    配置:
+        [版番号, 量子ビット数, 行数R,
+         ゲートコード ×(R×量子ビット数)（sumDoubleArray の gateCircuitData と同じ行優先の並び）]
+
+    Args:
+        numQubit (int): 量子ビット数
+        final_result_gate (list): second_convert_gate の回路レイアウト
+
+    Returns:
+        bytes: バイナリ形式の回路
+    """
+    rows = len(final_result_gate)
+    cells = np.zeros((rows, numQubit), dtype='<i4')
+    for i, result_gate in enumerate(final_result_gate):
+        for q, gate in enumerate(result_gate):
+            cells[i, q] = ENGINE_GATE_CODES.get(gate, 0)
+
+    header = np.array([CIRCUIT_BINARY_VERSION, numQubit, rows], dtype='<i4')
+    return np.concatenate([header, cells.reshape(-1)]).tobytes()
\ No newline at end of file
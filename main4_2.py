@@ -14,6 +14,9 @@
 3. 最適化計算の実行
 4. 量子回路レイアウトの生成
 5. 結果の評価・出力
+
+同じ入力（初期状態・目標状態・ゲート設定）の計算結果はキャッシュし、
+2回目以降は最適化計算を省略する
 """
 
 import numpy as np
@@ -21,11 +24,132 @@ import func_2 as func
 import gate_convert_2 as gc
 import time
 import copy
+import os
+import json
+import hashlib
+import threading
+from collections import OrderedDict
+from functools import lru_cache
 
 # 事前計算済みデータの読み込み
 json_data = func.data_read()
 convert_gate_data = gc.gate_convert_data_read()
 
+# ======= 計算結果キャッシュの設定 =======
+RESULT_CACHE_SIZE = int(os.environ.get('QCAL_RESULT_CACHE_SIZE', '256'))  # メモリに保持する結果数（LRU）
+RESULT_CACHE_DIR = os.environ.get('QCAL_RESULT_CACHE_DIR')               # ディスク保存先（未設定で無効）
+CACHE_KEY_DECIMALS = 6   # キーに使う座標・半径の丸め桁数
+GATE_TABLE_CACHE_SIZE = 16  # ゲート変換結果を保持する使用可能ゲートの組み合わせ数
+
+
+def gate_data_version():
+    """
+    事前計算データのハッシュ値（データ更新時にディスク上の古い結果を使わないようキーに含める）
+
+    Returns:
+        str: gate_result_1202.json と gate_convert_2.json の内容のSHA-256
+    """
+    digest = hashlib.sha256()
+    for path in ('gate_result_1202.json', 'gate_convert_2.json'):
+        with open(path, 'rb') as f:
+            digest.update(f.read())
+    return digest.hexdigest()
+
+
+GATE_DATA_VERSION = gate_data_version()
+
+_result_cache = OrderedDict()          # キー → 計算結果（最近使った順）
+_result_cache_lock = threading.Lock()  # ユーザーごとの計算スレッド間の排他
+
+
+def result_cache_key(saved_values1, saved_values2, gateLength, acceptGate):
+    """
+    計算結果キャッシュのキーを作成
+
+    初期状態・目標状態はブロッホ球座標に変換して丸めるため、
+    角度の表し方が異なっても同じ状態は同じキーになる
+
+    Args:
+        saved_values1 (list): 初期状態パラメータ [[phi, theta], ...]
+        saved_values2 (list): 目標状態パラメータ [[phi, theta, radius], ...]
+        gateLength (list): [短いゲート長, 長いゲート長]
+        acceptGate (list): 使用可能なゲート種類
+
+    Returns:
+        str: キー（SHA-256の16進文字列）
+    """
+    def quantize(values):
+        # -0.0 と 0.0 を同一視
+        return [round(float(value), CACHE_KEY_DECIMALS) + 0.0 for value in values]
+
+    content = {
+        'version': GATE_DATA_VERSION,
+        'initial': [quantize(func.coordinate_calc_input(phi, theta, 1)) for phi, theta in saved_values1],
+        'target': [quantize(func.coordinate_calc_input(phi, theta, radius)) for phi, theta, radius in saved_values2],
+        'radius': quantize([radius for _, _, radius in saved_values2]),
+        'gateLength': [int(length) for length in gateLength],
+        'acceptGate': list(acceptGate),
+    }
+    return hashlib.sha256(json.dumps(content, sort_keys=True).encode('utf-8')).hexdigest()
+
+
+def load_cached_result(key):
+    """
+    キャッシュから計算結果を取得（メモリ → ディスクの順に検索）
+
+    Args:
+        key (str): result_cache_key で作成したキー
+
+    Returns:
+        list or str or None: 計算結果（見つからない場合はNone）
+    """
+    with _result_cache_lock:
+        if key in _result_cache:
+            _result_cache.move_to_end(key)
+            return _result_cache[key]
+
+    if RESULT_CACHE_DIR:
+        try:
+            with open(os.path.join(RESULT_CACHE_DIR, key + '.json'), 'r') as f:
+                result = json.load(f)['result']
+        except (OSError, ValueError, KeyError):
+            return None
+        _remember_result(key, result)
+        return result
+    return None
+
+
+def store_cached_result(key, result):
+    """
+    計算結果をキャッシュに保存（ディスク保存が有効な場合はファイルにも書き込む）
+
+    Args:
+        key (str): result_cache_key で作成したキー
+        result (list or str): 量子回路レイアウト または エラーメッセージ
+    """
+    _remember_result(key, result)
+
+    if RESULT_CACHE_DIR:
+        path = os.path.join(RESULT_CACHE_DIR, key + '.json')
+        try:
+            os.makedirs(RESULT_CACHE_DIR, exist_ok=True)
+            # 書き込み途中のファイルを読まないよう、一時ファイルから置き換える
+            temporary = f'{path}.{os.getpid()}.{threading.get_ident()}.tmp'
+            with open(temporary, 'w') as f:
+                json.dump({'result': result}, f)
+            os.replace(temporary, path)
+        except OSError as e:
+            print("結果キャッシュの保存に失敗:", e)
+
+
+def _remember_result(key, result):
+    """メモリ上のLRUキャッシュに結果を追加し、上限を超えた古い結果を削除"""
+    with _result_cache_lock:
+        _result_cache[key] = result
+        _result_cache.move_to_end(key)
+        while len(_result_cache) > RESULT_CACHE_SIZE:
+            _result_cache.popitem(last=False)
+
 
 def gateConverter(max_short_gate_length, max_long_gate_length, acceptGate):
     """
@@ -38,13 +162,38 @@ def gateConverter(max_short_gate_length, max_long_gate_length, acceptGate):
         
     Returns:
         tuple: (長いゲート系列データ, 短いゲート系列データ)
+
+    Note:
+        変換済みのゲート系列は使用可能ゲートの組み合わせごとにキャッシュされ、
+        リクエスト間で共有される（戻り値の要素は変更しないこと）
     """
     # 最大ゲート数の設定
     MAX_SHORT_GATE_LENGTH = max_short_gate_length  # 前半最大ゲート数:0~22
     MAX_LONG_GATE_LENGTH = max_long_gate_length    # 後半最大ゲート数:0~22
 
+    # 変換・重複除去済みのゲート系列（使用可能ゲートごとにキャッシュ）
+    sorted_data = converted_gate_table(tuple(acceptGate))
+
+    # ゲート長でデータを分類
+    data_long = func.data_sort(sorted_data, MAX_LONG_GATE_LENGTH)
+    data_short = func.data_sort(sorted_data, MAX_SHORT_GATE_LENGTH)
+    
+    return data_long, data_short
+
+
+@lru_cache(maxsize=GATE_TABLE_CACHE_SIZE)
+def converted_gate_table(acceptGate):
+    """
+    使用可能ゲートで表したゲート系列を、ゲート長順・重複除去済みで作成
+
+    Args:
+        acceptGate (tuple): 使用可能なゲート種類（キャッシュのキーのためタプル）
+
+    Returns:
+        list: ゲート系列データ [[gate_sequence, matrix], ...]（ゲート長の昇順）
+    """
     # 変換可能ゲートの設定（例:["H","T","S","X","Y","Z"]）
-    ACCEPT_GATE = acceptGate
+    ACCEPT_GATE = list(acceptGate)
 
     # データのディープコピー（元データを保護）
     INPUT_DATA = copy.deepcopy(json_data)
@@ -57,14 +206,11 @@ def gateConverter(max_short_gate_length, max_long_gate_length, acceptGate):
     sorted_indices = np.argsort([len(data[0]) for data in first_converted_gate])
     sorted_data = [first_converted_gate[i] for i in sorted_indices]
 
-    # ゲート長でデータを分類
-    data_long = func.data_sort(sorted_data, MAX_LONG_GATE_LENGTH)
-    data_short = func.data_sort(sorted_data, MAX_SHORT_GATE_LENGTH)
-    
-    return data_long, data_short
+    # グローバル位相のみ異なる系列を除去（同値類ごとに最短の系列を残す）
+    return func.dedupe_gate_data(sorted_data)
 
 
-def submit2(data_long, data_short, saved_values1, saved_values2, update_progress_callback):
+def submit2(data_long, data_short, saved_values1, saved_values2, update_progress_callback, update_result_callback=None):
     """
     量子回路生成の実行と結果評価
     
@@ -74,6 +220,7 @@ def submit2(data_long, data_short, saved_values1, saved_values2, update_progress
         saved_values1 (list): 初期状態パラメータ [[phi, theta], ...]
         saved_values2 (list): 目標状態パラメータ [[phi, theta, radius], ...]
         update_progress_callback (callable): 進捗更新コールバック
+        update_result_callback (callable): 途中結果（回路レイアウト, 最小誤差）のコールバック（省略可）
         
     Returns:
         list or str: 生成された量子回路 または エラーメッセージ
@@ -107,10 +254,16 @@ def submit2(data_long, data_short, saved_values1, saved_values2, update_progress
         target_radius.append(params[2])
         target_coordinates.append(func.coordinate_calc_input(params[0], params[1], params[2]))
     
+    def publish_result(gate_array, min_diff):
+        # 途中結果も最終結果と同じ回路レイアウトに変換して通知
+        if update_result_callback is not None:
+            update_result_callback(gc.second_convert_gate(numQubit, gate_array), min_diff)
+
     # メインの最適化計算実行
     start = time.time()
     gate_array, result_state = func.mainCalc(
-        data_long, data_short, initialize, target_coordinates, target_radius, update_progress_callback
+        data_long, data_short, initialize, target_coordinates, target_radius, update_progress_callback,
+        update_result_callback=publish_result
     )
 
     # 計算失敗の場合
@@ -147,7 +300,7 @@ def submit2(data_long, data_short, saved_values1, saved_values2, update_progress
         return final_gate_array
 
 
-def start(data, gateLength, acceptGate, update_progress_callback=None):
+def start(data, gateLength, acceptGate, update_progress_callback=None, update_result_callback=None):
     """
     量子回路生成システムのエントリーポイント
     
@@ -156,6 +309,7 @@ def start(data, gateLength, acceptGate, update_progress_callback=None):
         gateLength (list): [短いゲート長, 長いゲート長]
         acceptGate (list): 使用可能なゲート種類
         update_progress_callback (callable): 進捗更新コールバック
+        update_result_callback (callable): 途中結果（回路レイアウト, 最小誤差）のコールバック
         
     Returns:
         list or str or bool: 生成された量子回路 / エラーメッセージ / False（失敗時）
@@ -164,9 +318,6 @@ def start(data, gateLength, acceptGate, update_progress_callback=None):
     max_long_gate_length = gateLength[1]
     max_short_gate_length = gateLength[0]
     
-    # ゲート変換の実行
-    data_long, data_short = gateConverter(max_short_gate_length, max_long_gate_length, acceptGate)
-    
     # 入力データの解析・変換
     saved_values1 = []  # 初期状態
     saved_values2 = []  # 目標状態
@@ -185,6 +336,21 @@ def start(data, gateLength, acceptGate, update_progress_callback=None):
         radius = float(data['target']['Radius'][f'{i}'])
         saved_values2.append([phi2, theta2, radius])
     
+    # 同じ入力の計算結果があれば再利用
+    cache_key = result_cache_key(saved_values1, saved_values2, gateLength, acceptGate)
+    cached = load_cached_result(cache_key)
+    if cached is not None:
+        print("キャッシュ済みの計算結果を使用")
+        return cached
+
+    # ゲート変換の実行
+    data_long, data_short = gateConverter(max_short_gate_length, max_long_gate_length, acceptGate)
+
     # メイン処理の実行
-    result = submit2(data_long, data_short, saved_values1, saved_values2, update_progress_callback)
+    result = submit2(data_long, data_short, saved_values1, saved_values2, update_progress_callback,
+                     update_result_callback)
+
+    # 回路・エラーメッセージは入力で決まるため保存（False = 停止・失敗は保存しない）
+    if result:
+        store_cached_result(cache_key, result)
     return result
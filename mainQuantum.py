@@ -24,7 +24,9 @@ from flask_socketio import SocketIO, emit, join_room, leave_room
 import time
 import threading
 import uuid
+import hashlib
 import main4_2 as getCircuit
+import gate_convert_2 as gc
 
 app = Flask(__name__)
 
@@ -76,7 +78,7 @@ def waitForCompletion(user_id):
         count += 1
     return True
 
-def gate_geration_task(user_id, data, gateLength, acceptGate, update_progress_callback):
+def gate_geration_task(user_id, data, gateLength, acceptGate, update_progress_callback, update_result_callback=None):
     """
     量子回路生成の長時間処理を実行する関数
     
@@ -86,9 +88,12 @@ def gate_geration_task(user_id, data, gateLength, acceptGate, update_progress_ca
         gateLength (int): 生成する回路の最大ゲート数
         acceptGate (list): 使用可能なゲートの種類
         update_progress_callback (callable): 進捗更新用のコールバック関数
+        update_result_callback (callable): 途中結果（最良の回路）送信用のコールバック関数
     
     Note:
         - 別スレッドで実行される重い処理
+        - 前半処理の探索は func_2 の共有プロセスプールで並列実行され、
+          このスレッドは進捗更新と停止チェックを行う
         - 計算結果はcalculation_results[user_id]に保存
         - エラー発生時はエラー情報を保存
     """
@@ -98,7 +103,8 @@ def gate_geration_task(user_id, data, gateLength, acceptGate, update_progress_ca
         # スレッド停止フラグの待機
         if waitForCompletion(user_id):
             # メインの量子回路生成処理を実行
-            result = getCircuit.start(data, gateLength, acceptGate, update_progress_callback=update_progress_callback)
+            result = getCircuit.start(data, gateLength, acceptGate, update_progress_callback=update_progress_callback,
+                                      update_result_callback=update_result_callback)
             calculation_results[user_id] = result  # 結果を保存
             user_state[user_id]["start"] = 0
             
@@ -117,10 +123,74 @@ def gate_geration_task(user_id, data, gateLength, acceptGate, update_progress_ca
         calculation_results[user_id] = {"error": str(e)}  # エラーを保存
 
 
+# 計算エンジン（WebAssemblyモジュールとEmscriptenグルーコード）の配置場所
+ENGINE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'static', 'cpp')
+ENGINE_FILES = ('qcal.wasm', 'qcal-simd.wasm', 'qcal.js', 'qcal-simd.js')
+
+# ファイル名ごとの (更新時刻, 内容のハッシュ)
+engine_hashes = {}
+
+
+def engine_hash(filename):
+    """
+    エンジンのファイルの内容のハッシュを返す（更新時刻が変わった場合のみ計算し直す）
+
+    Args:
+        filename (str): ENGINE_FILES のファイル名
+
+    Returns:
+        str or None: SHA-256の先頭16桁（ファイルがない場合はNone）
+    """
+    path = os.path.join(ENGINE_DIR, filename)
+    if not os.path.isfile(path):
+        return None
+    mtime = os.path.getmtime(path)
+    cached = engine_hashes.get(filename)
+    if cached and cached[0] == mtime:
+        return cached[1]
+    with open(path, 'rb') as f:
+        digest = hashlib.sha256(f.read()).hexdigest()[:16]
+    engine_hashes[filename] = (mtime, digest)
+    return digest
+
+
+@app.route('/engine_manifest')
+def engine_manifest():
+    """
+    エンジンのファイルの内容のハッシュを返すエンドポイント
+
+    Note:
+        フロントエンドは ?v=<ハッシュ> 付きのURLでエンジンを読み込むため、
+        このレスポンス自体はキャッシュさせない
+    """
+    hashes = {name: engine_hash(name) for name in ENGINE_FILES}
+    response = jsonify({name: digest for name, digest in hashes.items() if digest})
+    response.headers['Cache-Control'] = 'no-cache'
+    return response
+
+
 @app.route('/static/cpp/qcal.wasm')
+@app.route('/static/cpp/qcal-simd.wasm')
+@app.route('/static/cpp/qcal.js')
+@app.route('/static/cpp/qcal-simd.js')
 def wasm():
-    """WebAssembly（WASM）ファイルの配信エンドポイント"""
-    return send_from_directory('static/cpp', 'qcal.wasm')
+    """
+    計算エンジンの配信エンドポイント（WASMファイルとグルーコード、通常版・SIMD128版）
+
+    Note:
+        WASMファイルは instantiateStreaming / compileStreaming のため application/wasm で配信する。
+        ?v= が現在の内容のハッシュと一致する場合は1年間キャッシュさせ（immutable）、
+        それ以外は毎回 ETag で再検証させる
+    """
+    filename = request.path.rsplit('/', 1)[-1]
+    mimetype = 'application/wasm' if filename.endswith('.wasm') else 'text/javascript'
+    response = send_from_directory(ENGINE_DIR, filename, mimetype=mimetype)
+    version = request.args.get('v')
+    if version and version == engine_hash(filename):
+        response.headers['Cache-Control'] = 'public, max-age=31536000, immutable'
+    else:
+        response.headers['Cache-Control'] = 'no-cache'
+    return response
 
 
 @app.before_request
@@ -219,10 +289,27 @@ def get_vector():
             )
         return True
 
+    def update_result(gate_array, min_diff):
+        """
+        途中結果送信コールバック関数
+
+        計算ステップが進むごとに、その時点で確定した回路を送信する
+        （ユーザーは十分な結果が得られた時点で採用し、計算を停止できる）
+
+        Args:
+            gate_array (list): 確定済みの回路レイアウト
+            min_diff (float): 直前の計算ステップの最小誤差
+        """
+        socketio.emit(
+            'result_update',
+            {'gate_array': gate_array, 'min_diff': float(min_diff), 'page': data['page']},
+            room=user_id
+        )
+
     # 非同期計算スレッドを開始
     thread = threading.Thread(
         target=gate_geration_task, 
-        args=(user_id, data['data'], data['gateLength'], data['acceptGate'], update_progress)
+        args=(user_id, data['data'], data['gateLength'], data['acceptGate'], update_progress, update_result)
     )
     thread.daemon = True  # メインプロセス終了時に自動終了
     thread.start()
@@ -237,6 +324,10 @@ def get_vector():
 def get_result():
     """
     計算結果の取得エンドポイント
+
+    Query:
+        - format: 'binary' の場合、回路を gate_convert_2.encode_circuit_binary の形式
+                  （application/octet-stream）で返す（エラーは従来どおりJSON）
     
     Returns:
         JSON: 計算結果または結果待ちメッセージ
@@ -253,6 +344,8 @@ def get_result():
         return jsonify({"message": "result none"}), 400  # エラー時
     if isinstance(result, str):
         return jsonify({"message": result}), 400  # エラー時
+    if request.args.get('format') == 'binary' and isinstance(result, list):
+        return Response(gc.encode_circuit_binary(len(result[0]), result), mimetype='application/octet-stream')
     return jsonify(result), 200
 
 
@@ -274,6 +367,15 @@ def handle_connect():
         join_room(user_id)  # ユーザーをルームに追加
         print(f"User {user_id} connected.")
 
+@socketio.on('cancel_calculation')
+def handle_cancel_calculation():
+    """途中結果の採用時の処理：実行中の計算を停止してサーバーのCPUを解放"""
+    user_id = session.get('user_id')
+    thread = user_threads.get(user_id)
+    if thread is not None and thread.is_alive():
+        thread_stop_flags[user_id] = True  # スレッド停止フラグをセット
+        print(f"User {user_id} accepted an intermediate result. Stopping associated thread.")
+
 @socketio.on('disconnect')
 def handle_disconnect():
     """ユーザー切断時の処理"""
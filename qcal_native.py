@@ -0,0 +1,244 @@
+# #----------------------------------------------------
+#   Program name : qcal_native.py
+#   Date of program : 2026/10/14
+#   Author : tomo-ing
+#----------------------------------------------------
+
+"""
+qcal.cpp ネイティブ共有ライブラリのctypesバインディング
+ブラウザ（WebAssembly）と同じ計算エンジンをPythonバックエンドから利用する
+
+主な機能:
+- 共有ライブラリ（libqcal.so / qcal.dll / libqcal.dylib）の読み込み
+- func_2.apply_controlled_gate と同じ引数のゲート適用関数
+- func_2.partical_trace と同じ引数・戻り値の密度行列計算関数
+- 候補ゲート群のブロッホ座標をまとめて求めるバッチ評価関数
+- 状態ベクトルからの測定サンプリング（指定した量子ビットの結果ごとの回数）
+- 量子ビット対の縮約密度行列と concurrence・purity（func_2.pair_density_matrices と同じ引数・戻り値）
+
+ビルド方法（リポジトリ直下で実行）:
+    g++ -std=c++17 -O3 -march=native -shared -fPIC -pthread static/cpp/qcal.cpp -o libqcal.so
+
+環境変数 QCAL_NATIVE_LIB でライブラリのパスを指定できます。
+ライブラリが見つからない場合は available() が False を返し、
+func_2.py は従来のPython実装を使用します。
+"""
+
+import ctypes
+import os
+import sys
+
+import numpy as np
+
+# 共有ライブラリのファイル名（OSごと）
+if sys.platform.startswith('win'):
+    LIBRARY_NAME = 'qcal.dll'
+elif sys.platform == 'darwin':
+    LIBRARY_NAME = 'libqcal.dylib'
+else:
+    LIBRARY_NAME = 'libqcal.so'
+
+_double_p = ctypes.POINTER(ctypes.c_double)
+
+
+def _load_library():
+    """
+    共有ライブラリを読み込み、関数の引数型を設定する
+
+    Returns:
+        ctypes.CDLL or None: 読み込んだライブラリ（見つからない場合はNone）
+    """
+    path = os.environ.get('QCAL_NATIVE_LIB',
+                          os.path.join(os.path.dirname(os.path.abspath(__file__)), LIBRARY_NAME))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.applyGateMatrix.argtypes = [_double_p, ctypes.c_int, ctypes.c_int,
+                                    ctypes.c_uint32, ctypes.c_uint32, _double_p]
+    lib.applyGateMatrix.restype = None
+    lib.calculateDensityMatrices.argtypes = [_double_p, ctypes.c_int, _double_p]
+    lib.calculateDensityMatrices.restype = None
+    lib.evaluateGateCandidates.argtypes = [_double_p, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                           _double_p, ctypes.c_int, _double_p]
+    lib.evaluateGateCandidates.restype = None
+    lib.sampleMeasurementsInto.argtypes = [_double_p, ctypes.c_int, ctypes.c_int, ctypes.c_uint32,
+                                           ctypes.c_int, ctypes.c_uint32, ctypes.POINTER(ctypes.c_int32)]
+    lib.sampleMeasurementsInto.restype = None
+    lib.calculatePairMetricsInto.argtypes = [_double_p, ctypes.c_int, ctypes.c_int,
+                                             ctypes.POINTER(ctypes.c_int32), ctypes.c_int, _double_p]
+    lib.calculatePairMetricsInto.restype = None
+    lib.setThreadCount.argtypes = [ctypes.c_int]
+    lib.setThreadCount.restype = None
+
+    # 論理コア数に合わせて計算スレッド数を設定
+    lib.setThreadCount(os.cpu_count() or 1)
+    return lib
+
+
+_lib = _load_library()
+
+
+def available():
+    """
+    ネイティブエンジンが利用可能かを返す
+
+    Returns:
+        bool: 共有ライブラリを読み込めた場合True
+    """
+    return _lib is not None
+
+
+def set_thread_count(count):
+    """
+    ネイティブエンジンの計算スレッド数を設定
+
+    Args:
+        count (int): スレッド数
+    """
+    _lib.setThreadCount(count)
+
+
+def _as_pointer(array):
+    """
+    complex128配列の先頭を double* として渡すためのポインタに変換
+    """
+    return array.ctypes.data_as(_double_p)
+
+
+def apply_controlled_gate(state_vector, gate, targetGateVector, numQubit):
+    """
+    制御ゲートを状態ベクトルに適用（func_2.apply_controlled_gate のネイティブ版）
+
+    Args:
+        state_vector (numpy.ndarray): 現在の状態ベクトル
+        gate (list): ゲート配置情報 ['c', 'TG', '', ...]
+                     'c': 制御ビット, 'TG': ターゲットビット, '': 何もしない
+        targetGateVector (numpy.ndarray): 適用するゲートの2x2行列
+        numQubit (int): 量子ビット数
+
+    Returns:
+        numpy.ndarray: ゲート適用後の状態ベクトル（complex128）
+    """
+    targetQubit = -1
+    controlOnes = 0
+
+    # ターゲット量子ビットと制御ビットのマスクを作成
+    for i in range(numQubit):
+        if gate[i] == "TG":
+            targetQubit = i
+        elif gate[i] == "c":
+            controlOnes |= 1 << i
+
+    if targetQubit == -1:
+        return state_vector
+
+    # エンジンと同じメモリ配置（実部・虚部交互）の配列を用意
+    state = np.ascontiguousarray(state_vector, dtype=np.complex128)
+    pack = np.ascontiguousarray(targetGateVector, dtype=np.complex128)
+
+    _lib.applyGateMatrix(_as_pointer(state), numQubit, targetQubit, controlOnes, 0, _as_pointer(pack))
+    return state
+
+
+def partical_trace(state, numQubit):
+    """
+    各量子ビットの密度行列を計算（func_2.partical_trace のネイティブ版）
+
+    Args:
+        state (numpy.ndarray): 多量子ビット状態ベクトル
+        numQubit (int): 量子ビット数
+
+    Returns:
+        numpy.ndarray: 各量子ビットの2x2密度行列の配列 [numQubit, 2, 2]
+    """
+    state = np.ascontiguousarray(state, dtype=np.complex128)
+    densityMatrix = np.zeros((numQubit, 2, 2), dtype=np.complex128)
+
+    _lib.calculateDensityMatrices(_as_pointer(state), numQubit, _as_pointer(densityMatrix))
+    return densityMatrix
+
+
+def evaluate_gate_candidates(state_vector, numQubit, targetQubit, controlQubit, candidates):
+    """
+    候補ゲート群を適用した結果のブロッホ座標をまとめて計算（func_2.evaluate_gate_candidates のネイティブ版）
+
+    Args:
+        state_vector (numpy.ndarray): 基準の状態ベクトル（変更しない）
+        numQubit (int): 量子ビット数
+        targetQubit (int): 候補ゲートを適用する量子ビット
+        controlQubit (int): 候補ゲートの後に適用するCNOTの制御ビット（-1の場合はCNOTなし）
+        candidates (numpy.ndarray): 候補ゲート行列 [K, 2, 2]
+
+    Returns:
+        numpy.ndarray: 候補ごとのブロッホ座標 [K, 2, 3]（[:, 0]: ターゲット, [:, 1]: 制御ビット）
+    """
+    state = np.ascontiguousarray(state_vector, dtype=np.complex128)
+    packs = np.ascontiguousarray(candidates, dtype=np.complex128)
+    coordinates = np.zeros((len(packs), 2, 3), dtype=np.float64)
+
+    _lib.evaluateGateCandidates(_as_pointer(state), numQubit, targetQubit, controlQubit,
+                                _as_pointer(packs), len(packs), _as_pointer(coordinates))
+    return coordinates
+
+
+def sample_measurements(state_vector, numQubit, qubits, shots, seed=None):
+    """
+    状態ベクトルから測定結果をサンプリングし、結果ごとの回数を返す
+
+    Args:
+        state_vector (numpy.ndarray): 多量子ビット状態ベクトル
+        numQubit (int): 量子ビット数
+        qubits (list): 測定する量子ビット番号
+        shots (int): 測定回数
+        seed (int): 乱数の種（Noneの場合はランダム）
+
+    Returns:
+        numpy.ndarray: 結果ごとの回数 [2^len(qubits)]
+                       （量子ビットを番号の昇順に並べ、最初の量子ビットを最上位ビットとした番号）
+    """
+    state = np.ascontiguousarray(state_vector, dtype=np.complex128)
+    qubitMask = 0
+    for q in qubits:
+        qubitMask |= 1 << q
+    if seed is None:
+        seed = int.from_bytes(os.urandom(4), 'little')
+
+    qubitMask &= (1 << numQubit) - 1  # エンジンと同じく量子ビット数の範囲外のビットは除く
+
+    # 結果の配列は呼び出しごとに確保（検索スレッドから同時に呼び出されるため、エンジン内の配列は使わない）
+    counts = np.zeros(1 << bin(qubitMask).count('1'), dtype=np.int32)
+    _lib.sampleMeasurementsInto(_as_pointer(state), numQubit, 0, qubitMask, shots, seed & 0xFFFFFFFF,
+                                counts.ctypes.data_as(ctypes.POINTER(ctypes.c_int32)))
+    return counts
+
+
+# 量子ビット対1件当たりの結果の要素数（qcal.cpp の PAIR_METRIC_SIZE と共通）
+PAIR_METRIC_SIZE = 34
+
+
+def pair_density_matrices(state_vector, numQubit, pairs):
+    """
+    量子ビット対ごとの縮約密度行列と concurrence・purity を計算（func_2.pair_density_matrices のネイティブ版）
+    全ての対を状態ベクトルの1回の走査で計算する
+
+    Args:
+        state_vector (numpy.ndarray): 多量子ビット状態ベクトル
+        numQubit (int): 量子ビット数
+        pairs (list): 量子ビット対 [[qubit_a, qubit_b], ...]
+
+    Returns:
+        tuple: (縮約密度行列 [P, 4, 4], concurrence [P], purity [P])
+    """
+    state = np.ascontiguousarray(state_vector, dtype=np.complex128)
+    flat = np.ascontiguousarray(np.asarray(pairs, dtype=np.int32).reshape(-1))
+
+    # 結果の配列は呼び出しごとに確保（検索スレッドから同時に呼び出されるため、エンジン内の配列は使わない）
+    metrics = np.zeros((len(pairs), PAIR_METRIC_SIZE), dtype=np.float64)
+
+    _lib.calculatePairMetricsInto(_as_pointer(state), numQubit, 0,
+                                  flat.ctypes.data_as(ctypes.POINTER(ctypes.c_int32)), len(pairs),
+                                  metrics.ctypes.data_as(_double_p))
+    rho = np.ascontiguousarray(metrics[:, :32]).view(np.complex128).reshape(len(pairs), 4, 4)
+    return rho, metrics[:, 32].copy(), metrics[:, 33].copy()
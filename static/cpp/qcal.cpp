@@ -34,89 +34,917 @@
  * - 制御ゲートの処理
  * - 密度行列計算とトレース演算
  * - 量子回路の実行とシミュレーション
+ *
+ * Emscripten以外のコンパイラでは、Pythonバックエンド（qcal_native.py）から
+ * ctypesで読み込むネイティブ共有ライブラリとしてビルドできます。
  */
 
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE __attribute__((visibility("default"))) // ネイティブ共有ライブラリの公開関数
+#include <chrono>
+// 経過時間（ミリ秒）：ネイティブビルドでの emscripten_get_now の代替
+inline double emscripten_get_now(){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
 #include <iostream>
-// #include <vector>
+#include <vector>
 #include <cmath>
 #include <complex>
 // #include <array>
 // #include <string>
-// #include <cstring>
-// #include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <cstdint>
 // #include <chrono>
-// #include <thread>
+#include <thread>
 // #include <bitset>
 // #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h> // SIMD128ビルド（-msimd128）でのみ使用
+#endif
 
 // 標準ライブラリの名前空間を使用
 using namespace std;
 
+/**
+ * @brief 並列実行を開始する最小ペア数
+ *
+ * これより小さいスイープではスレッドの起床コストが演算時間を上回るため、
+ * 呼び出し元スレッドのみで処理します（2^14ペア ≒ 15量子ビット）。
+ */
+const int PARALLEL_MIN_PAIRS = 1 << 14;
+
+/**
+ * @brief 同時に使用する最大スレッド数
+ */
+const int MAX_THREADS = 64;
+
+/**
+ * @brief ゲート行列の種類（calculatGateStateで分類し、gateKindsに格納）
+ *
+ * - GATE_DENSE: 一般の2×2行列（H, 部分回転中のX/Y等）
+ * - GATE_DIAGONAL: 対角行列（Z, S, T, 位相ゲート）… 振幅のスケーリングのみ
+ * - GATE_ANTI_DIAGONAL: 反対角行列（X, Y）… 振幅の入れ替えとスケーリングのみ
+ */
+const int GATE_DENSE = 0;
+const int GATE_DIAGONAL = 1;
+const int GATE_ANTI_DIAGONAL = 2;
+
+/**
+ * @brief ゲート行列要素を0または1とみなす許容誤差
+ *
+ * cos(π/2) 等の丸め誤差（~1e-16）を吸収するための値です。
+ */
+const double GATE_ZERO_EPS = 1e-12;
+
+/**
+ * @brief 密度行列計算で1タイルとして連続処理する振幅数（2^14振幅 = 倍精度256KB）
+ *
+ * タイル内のビットは1回の読み込みでoff-diagonal・diagonal要素をまとめて求めます。
+ */
+const int TRACE_TILE_BITS = 14;
+
+/**
+ * @brief タイルより上位のビットを処理する際に連続して読む振幅数（2^6振幅 = 1KB）
+ *
+ * 上位ビットは (TRACE_TILE_BITS - TRACE_RUN_BITS) ビットずつまとめ、
+ * 2^TRACE_TILE_BITS 振幅のキューブ単位で処理します。
+ */
+const int TRACE_RUN_BITS = 6;
+
+/**
+ * @brief 複数ゲートをまとめて適用するブロックの振幅数（2^12振幅 = 倍精度64KB）
+ *
+ * ターゲットがブロック内（下位ビット）に収まる連続ゲートは、ブロックごとに全ゲートを
+ * 適用してから次のブロックへ進み、状態ベクトル全体の読み書きを1回にまとめます。
+ */
+const int GATE_BLOCK_BITS = 12;
+
+/**
+ * @brief ブロック外ターゲットを入れ替えるか判定するために先読みするゲート数
+ */
+const int SWAP_LOOKAHEAD = 32;
+
+/**
+ * @brief 量子ビットの入れ替えを行う最小の削減スイープ数
+ *
+ * 先読み範囲でのターゲット使用回数が、入れ替えでブロック外に出る量子ビットより
+ * この値以上多い場合に入れ替えます（入れ替えと復元の2スイープ分を上回る場合）。
+ */
+const int SWAP_MIN_GAIN = 3;
+
+/**
+ * @brief ゲート演算・密度行列計算のインデックス範囲を分割実行するワーカースレッドプール
+ *
+ * Emscriptenのpthread（-pthread, PTHREAD_POOL_SIZE）でビルドした場合、
+ * 各ワーカーは共有WebAssembly.Memory上の同じ状態ベクトルを直接更新します。
+ * スレッドは一度だけ生成し、ジョブごとに世代番号で起床させます。
+ * pthread非対応ビルドでは常に呼び出し元スレッドで逐次実行します。
+ */
+struct ThreadPool {
+    vector<thread> workers;                       // ヘルパースレッド（呼び出し元スレッドを除く）
+    mutex runMtx;                                 // 実行中のジョブの排他（ジョブは同時に1つ）
+    mutex mtx;                                    // ジョブ受け渡し用ロック
+    condition_variable startCv;                   // ジョブ開始通知
+    condition_variable doneCv;                    // ジョブ完了通知
+    const function<void(int, int, int)>* job = nullptr; // 実行中のジョブ (スレッド番号, 開始, 終了)
+    int jobSize = 0;                              // ジョブのインデックス範囲
+    int generation = 0;                           // ジョブ世代番号
+    int pending = 0;                              // 未完了のヘルパー数
+    bool stop = false;                            // 終了要求フラグ
+
+    /**
+     * @brief スレッド番号に対応する担当範囲を計算
+     */
+    static void chunkRange(int size, int parts, int index, int& begin, int& end){
+        int base = size / parts;
+        int rest = size % parts;
+        begin = index * base + (index < rest ? index : rest);
+        end = begin + base + (index < rest ? 1 : 0);
+    }
+
+    ~ThreadPool(){ shutdown(); }
+
+    int threadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    void workerLoop(int index){
+        int seen = 0;
+        while (true){
+            const function<void(int, int, int)>* currentJob;
+            int size;
+            {
+                unique_lock<mutex> lock(mtx);
+                startCv.wait(lock, [&]{ return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+                currentJob = job;
+                size = jobSize;
+            }
+            int begin, end;
+            chunkRange(size, threadCount(), index, begin, end);
+            if (begin < end) (*currentJob)(index, begin, end);
+            {
+                lock_guard<mutex> lock(mtx);
+                if (--pending == 0) doneCv.notify_one();
+            }
+        }
+    }
+
+    /**
+     * @brief ヘルパースレッド数を再設定する（既存スレッドは終了させて作り直す）
+     * @param count 呼び出し元スレッドを含むスレッド数
+     */
+    void resize(int count){
+        lock_guard<mutex> running(runMtx); // 実行中のジョブの完了を待つ
+        shutdown();
+        stop = false;
+        for (int i = 1; i < count; ++i){
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    void shutdown(){
+        {
+            lock_guard<mutex> lock(mtx);
+            stop = true;
+        }
+        startCv.notify_all();
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+    }
+
+    /**
+     * @brief [0, size) を全スレッドで分割して実行（呼び出し元はスレッド0を担当）
+     *
+     * 別のホストスレッド（ネイティブ共有ライブラリの検索スレッドなど）のジョブや
+     * ジョブ内からの呼び出しでプールが使用中の場合は実行せずに0を返します。
+     *
+     * @return 使用したスレッド数（プールが使用中の場合は0）
+     */
+    int tryRun(int size, const function<void(int, int, int)>& fn){
+        unique_lock<mutex> running(runMtx, try_to_lock);
+        if (!running.owns_lock()){
+            return 0;
+        }
+        {
+            lock_guard<mutex> lock(mtx);
+            job = &fn;
+            jobSize = size;
+            pending = static_cast<int>(workers.size());
+            ++generation;
+        }
+        startCv.notify_all();
+        int begin, end;
+        chunkRange(size, threadCount(), 0, begin, end);
+        if (begin < end) fn(0, begin, end);
+        unique_lock<mutex> lock(mtx);
+        doneCv.wait(lock, [&]{ return pending == 0; });
+        return threadCount();
+    }
+};
+
+static ThreadPool threadPool; // エンジン全体で共有するスレッドプール
+
+/**
+ * @brief インデックス範囲 [0, size) を並列に処理する
+ *
+ * 範囲が小さい場合やスレッドが1本の場合、プールが別のジョブを実行中の場合は呼び出し元で一括処理します。
+ *
+ * @param size 処理するインデックス数
+ * @param fn 処理関数 fn(スレッド番号, 開始インデックス, 終了インデックス)
+ * @param minSize 並列実行する最小インデックス数（タイル単位の処理では小さく指定）
+ * @return int 使用したスレッド数（部分和の集計に使用）
+ */
+int parallelFor(int size, const function<void(int, int, int)>& fn, int minSize = PARALLEL_MIN_PAIRS){
+    if (size < max(minSize, 2) || threadPool.threadCount() == 1){
+        fn(0, 0, size);
+        return 1;
+    }
+    int count = threadPool.tryRun(size, fn);
+    if (count == 0){
+        fn(0, 0, size);
+        return 1;
+    }
+    return count;
+}
+
+/**
+ * @brief 計算に使用するスレッド数を設定する（JavaScript側から呼び出し）
+ *
+ * worker.jsから navigator.hardwareConcurrency を、qcal_native.pyから os.cpu_count() を
+ * 渡して呼び出します。pthread非対応のWebAssemblyビルドでは何もしません。
+ *
+ * @param count 呼び出し元スレッドを含むスレッド数
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void setThreadCount(int count){
+#if defined(__EMSCRIPTEN_PTHREADS__) || !defined(__EMSCRIPTEN__)
+    count = max(1, min(count, MAX_THREADS));
+    if (count != threadPool.threadCount()){
+        threadPool.resize(count);
+    }
+#else
+    (void)count;
+#endif
+}
+
+/**
+ * @brief フェーズ別計測カウンタの位置（共有メモリ上のカウンタブロック、double配列）
+ *
+ * 時間はミリ秒（emscripten_get_now）で、sumDoubleArray の呼び出しごとに0から集計します。
+ */
+enum PhaseCounter {
+    COUNTER_SEQUENCE = 0,  // 計測した呼び出しの通し番号（リセットしない）
+    COUNTER_TOTAL_MS,      // sumDoubleArray 全体
+    COUNTER_INITIALIZE_MS, // 初期化（チェックポイント復元・クラスタ初期化を含む）
+    COUNTER_CIRCUIT_MS,    // 演算リストの読み出しとゲート融合（ゲート適用を除く）
+    COUNTER_GATE_MS,       // ゲート適用（スイープ・ブロック処理・量子ビット入れ替え）
+    COUNTER_TRACE_MS,      // 密度行列計算（タイル処理に融合した最後のゲートを含む）
+    COUNTER_SWEEPS,        // 状態ベクトルの走査回数
+    COUNTER_PAIRS,         // 更新した振幅ペア数
+    COUNTER_SWAPS,         // 量子ビットの並び替え回数
+    COUNTER_LENGTH         // カウンタブロックの要素数
+};
+
+static double* phaseCounters = nullptr; // カウンタブロック（nullptrで計測無効）
+
+/**
+ * @brief フェーズ別計測のカウンタブロックを設定する（JavaScript側から呼び出し）
+ *
+ * 無効時（nullptr）は各計測点がポインタの判定1回だけになります。
+ *
+ * @param counters カウンタブロック（COUNTER_LENGTH 要素、nullptrで計測無効）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void setPhaseCounters(double* counters){
+    phaseCounters = counters;
+}
+
+alignas(16) static double phaseCounterStorage[COUNTER_LENGTH]; // Worker用のカウンタブロック
+
+/**
+ * @brief Worker用のカウンタブロックの先頭を返す（JavaScript側から読み取り）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE double* phaseCounterBlock(){
+    return phaseCounterStorage;
+}
+
+/**
+ * @brief カウンタに値を加算する（計測無効時は何もしない）
+ */
+inline void countPhase(int counter, double value){
+    if (phaseCounters){
+        phaseCounters[counter] += value;
+    }
+}
+
+/**
+ * @brief ゲート1回分の走査と振幅ペア数を加算する
+ *
+ * @param numQubits 量子ビット数
+ * @param controlMask 制御ビットのマスク（制御ビット1つごとにペア数が半分）
+ */
+inline void countGateSweep(int numQubits, uint32_t controlMask){
+    if (phaseCounters){
+        phaseCounters[COUNTER_SWEEPS] += 1;
+        phaseCounters[COUNTER_PAIRS] += ldexp(1.0, numQubits - 1 - __builtin_popcount(controlMask));
+    }
+}
+
+/**
+ * @brief スコープの経過時間をカウンタに加算するタイマー
+ *
+ * excluded を指定すると、その間に excluded へ加算された時間（入れ子のフェーズ）を差し引きます。
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(int counter, int excluded = -1)
+        : counter(counter), excluded(excluded),
+          start(phaseCounters ? emscripten_get_now() : 0.0),
+          excludedStart(phaseCounters && excluded >= 0 ? phaseCounters[excluded] : 0.0) {}
+
+    ~PhaseTimer(){
+        if (phaseCounters){
+            double elapsed = emscripten_get_now() - start;
+            if (excluded >= 0){
+                elapsed -= phaseCounters[excluded] - excludedStart;
+            }
+            phaseCounters[counter] += elapsed;
+        }
+    }
+
+private:
+    int counter;          // 加算先のカウンタ
+    int excluded;         // 差し引く入れ子のカウンタ（-1でなし）
+    double start;         // 開始時刻
+    double excludedStart; // 開始時の入れ子カウンタの値
+};
+
+/**
+ * @brief 演算用に展開した2×2複素ゲート行列
+ *
+ * SIMD128ビルドでは (実部, 虚部) を1つのf64x2レーン対として扱うため、
+ * 複素積 t·s = t.r·(s.r, s.i) + t.i·(-s.i, s.r) の係数を事前に用意します。
+ */
+struct GateCoefficients {
+    double t00r, t00i, t01r, t01i, t10r, t10i, t11r, t11i;
+#ifdef __wasm_simd128__
+    v128_t r00, i00, r01, i01, r10, i10, r11, i11; // (t.r, t.r) と (-t.i, t.i)
+#endif
+};
+
+/**
+ * @brief gatePacks内の1ゲート分（8要素）から演算用係数を作成する
+ *
+ * @param pack ゲート行列要素 [T₀₀r, T₀₀i, T₀₁r, T₀₁i, T₁₀r, T₁₀i, T₁₁r, T₁₁i]
+ * @return GateCoefficients 演算用係数
+ */
+inline GateCoefficients loadGateCoefficients(const double* pack){
+    GateCoefficients g;
+    g.t00r = pack[0]; g.t00i = pack[1];
+    g.t01r = pack[2]; g.t01i = pack[3];
+    g.t10r = pack[4]; g.t10i = pack[5];
+    g.t11r = pack[6]; g.t11i = pack[7];
+#ifdef __wasm_simd128__
+    g.r00 = wasm_f64x2_splat(g.t00r); g.i00 = wasm_f64x2_make(-g.t00i, g.t00i);
+    g.r01 = wasm_f64x2_splat(g.t01r); g.i01 = wasm_f64x2_make(-g.t01i, g.t01i);
+    g.r10 = wasm_f64x2_splat(g.t10r); g.i10 = wasm_f64x2_make(-g.t10i, g.t10i);
+    g.r11 = wasm_f64x2_splat(g.t11r); g.i11 = wasm_f64x2_make(-g.t11i, g.t11i);
+#endif
+    return g;
+}
+
+/**
+ * @brief 振幅ペア (|0⟩, |1⟩) に2×2ゲート行列を適用する
+ *
+ * 状態ベクトルの要素型 Real（double / float）ごとに実体化します。
+ * 係数は倍精度のまま演算し、書き戻し時に Real へ丸めます。
+ *
+ * @param state 量子状態ベクトル（実部・虚部交互配列）
+ * @param i00 |0⟩側振幅の実部インデックス
+ * @param i10 |1⟩側振幅の実部インデックス
+ * @param g 演算用ゲート係数
+ */
+template <typename Real>
+inline void applyGatePair(Real* state, int i00, int i10, const GateCoefficients& g){
+    int i01 = i00 | 1;  // |0⟩状態ペアの虚部
+    int i11 = i10 | 1;  // |1⟩状態ペアの虚部
+
+    // 現在の状態ベクトル要素を取得
+    double s0r = state[i00]; // |0⟩の実部
+    double s0i = state[i01]; // |0⟩の虚部
+    double s1r = state[i10]; // |1⟩の実部
+    double s1i = state[i11]; // |1⟩の虚部
+
+    // 行列演算：新しい状態 = ゲート行列 × 現在の状態
+    state[i00] = s0r*g.t00r + s1r*g.t01r - s0i*g.t00i - s1i*g.t01i;
+    state[i01] = s0r*g.t00i + s1r*g.t01i + s0i*g.t00r + s1i *g.t01r;
+    state[i10] = s0r*g.t10r + s1r*g.t11r - s0i* g.t10i - s1i*g.t11i;
+    state[i11] = s0r*g.t10i + s1r*g.t11i + s0i*g.t10r + s1i*g.t11r;
+}
+
+/**
+ * @brief 1つの振幅に複素係数 (r, i) を掛ける
+ *
+ * @param state 量子状態ベクトル
+ * @param idx 振幅の実部インデックス
+ * @param r 係数の実部
+ * @param im 係数の虚部
+ */
+template <typename Real>
+inline void scaleAmplitude(Real* state, int idx, double r, double im){
+    double sr = state[idx];
+    double si = state[idx | 1];
+    state[idx] = sr*r - si*im;
+    state[idx | 1] = sr*im + si*r;
+}
+
+/**
+ * @brief 対角ゲート diag(T₀₀, T₁₁) を振幅ペアに適用する
+ */
+template <typename Real>
+inline void applyDiagonalPair(Real* state, int i00, int i10, const GateCoefficients& g){
+    scaleAmplitude(state, i00, g.t00r, g.t00i);
+    scaleAmplitude(state, i10, g.t11r, g.t11i);
+}
+
+/**
+ * @brief 位相ゲート diag(1, T₁₁) を振幅ペアに適用する（|1⟩側のみ読み書き）
+ */
+template <typename Real>
+inline void applyPhasePair(Real* state, int, int i10, const GateCoefficients& g){
+    scaleAmplitude(state, i10, g.t11r, g.t11i);
+}
+
+/**
+ * @brief 反対角ゲート [[0, T₀₁], [T₁₀, 0]] を振幅ペアに適用する
+ */
+template <typename Real>
+inline void applyAntiDiagonalPair(Real* state, int i00, int i10, const GateCoefficients& g){
+    double s0r = state[i00], s0i = state[i00 | 1];
+    double s1r = state[i10], s1i = state[i10 | 1];
+    state[i00] = s1r*g.t01r - s1i*g.t01i;
+    state[i00 | 1] = s1r*g.t01i + s1i*g.t01r;
+    state[i10] = s0r*g.t10r - s0i*g.t10i;
+    state[i10 | 1] = s0r*g.t10i + s0i*g.t10r;
+}
+
+/**
+ * @brief Xゲート（T₀₁ = T₁₀ = 1）を振幅ペアに適用する（入れ替えのみ）
+ */
+template <typename Real>
+inline void applySwapPair(Real* state, int i00, int i10, const GateCoefficients&){
+    swap(state[i00], state[i10]);
+    swap(state[i00 | 1], state[i10 | 1]);
+}
+
+#ifdef __wasm_simd128__
+// 倍精度の状態ベクトルでは (実部, 虚部) を1つのf64x2として演算する
+
+inline void scaleAmplitude(double* state, int idx, v128_t r, v128_t im){
+    v128_t s = wasm_v128_load(state + idx);
+    wasm_v128_store(state + idx, wasm_f64x2_add(wasm_f64x2_mul(r, s), wasm_f64x2_mul(im, wasm_i64x2_shuffle(s, s, 1, 0))));
+}
+
+template <>
+inline void applyGatePair<double>(double* state, int i00, int i10, const GateCoefficients& g){
+    v128_t s0 = wasm_v128_load(state + i00);        // (s0r, s0i)
+    v128_t s1 = wasm_v128_load(state + i10);        // (s1r, s1i)
+    v128_t s0s = wasm_i64x2_shuffle(s0, s0, 1, 0);  // (s0i, s0r)
+    v128_t s1s = wasm_i64x2_shuffle(s1, s1, 1, 0);  // (s1i, s1r)
+
+    // 新しい状態 = ゲート行列 × 現在の状態（複素積をレーン単位で計算）
+    v128_t n0 = wasm_f64x2_add(
+        wasm_f64x2_add(wasm_f64x2_mul(g.r00, s0), wasm_f64x2_mul(g.i00, s0s)),
+        wasm_f64x2_add(wasm_f64x2_mul(g.r01, s1), wasm_f64x2_mul(g.i01, s1s)));
+    v128_t n1 = wasm_f64x2_add(
+        wasm_f64x2_add(wasm_f64x2_mul(g.r10, s0), wasm_f64x2_mul(g.i10, s0s)),
+        wasm_f64x2_add(wasm_f64x2_mul(g.r11, s1), wasm_f64x2_mul(g.i11, s1s)));
+    wasm_v128_store(state + i00, n0);
+    wasm_v128_store(state + i10, n1);
+}
+
+template <>
+inline void applyDiagonalPair<double>(double* state, int i00, int i10, const GateCoefficients& g){
+    scaleAmplitude(state, i00, g.r00, g.i00);
+    scaleAmplitude(state, i10, g.r11, g.i11);
+}
+
+template <>
+inline void applyPhasePair<double>(double* state, int, int i10, const GateCoefficients& g){
+    scaleAmplitude(state, i10, g.r11, g.i11);
+}
+
+template <>
+inline void applyAntiDiagonalPair<double>(double* state, int i00, int i10, const GateCoefficients& g){
+    v128_t s0 = wasm_v128_load(state + i00);
+    v128_t s1 = wasm_v128_load(state + i10);
+    wasm_v128_store(state + i00, wasm_f64x2_add(wasm_f64x2_mul(g.r01, s1), wasm_f64x2_mul(g.i01, wasm_i64x2_shuffle(s1, s1, 1, 0))));
+    wasm_v128_store(state + i10, wasm_f64x2_add(wasm_f64x2_mul(g.r10, s0), wasm_f64x2_mul(g.i10, wasm_i64x2_shuffle(s0, s0, 1, 0))));
+}
+
+template <>
+inline void applySwapPair<double>(double* state, int i00, int i10, const GateCoefficients&){
+    v128_t s0 = wasm_v128_load(state + i00);
+    wasm_v128_store(state + i00, wasm_v128_load(state + i10));
+    wasm_v128_store(state + i10, s0);
+}
+#endif
+
+/**
+ * @brief gatePacks内の1ゲート分（8要素）を対角・反対角・一般行列に分類する
+ *
+ * @param pack ゲート行列要素
+ * @return int GATE_DENSE / GATE_DIAGONAL / GATE_ANTI_DIAGONAL
+ */
+int classifyGatePack(const double* pack){
+    auto isZero = [&](int k){ return fabs(pack[k]) < GATE_ZERO_EPS && fabs(pack[k+1]) < GATE_ZERO_EPS; };
+    if (isZero(2) && isZero(4)){
+        return GATE_DIAGONAL;
+    }
+    if (isZero(0) && isZero(6)){
+        return GATE_ANTI_DIAGONAL;
+    }
+    return GATE_DENSE;
+}
+
+/**
+ * @brief 複素数要素が 1 + 0i とみなせるか判定する
+ */
+inline bool isUnitElement(double r, double im){
+    return fabs(r - 1.0) < GATE_ZERO_EPS && fabs(im) < GATE_ZERO_EPS;
+}
+
+/**
+ * @brief 固定ビット位置に0を挿入して振幅インデックスを生成する（pdep相当）
+ *
+ * 自由ビットの通し番号 k の各ビットを、fixedMask で指定された位置を
+ * 避けて下位から順に配置します。i00 の計算を複数ビットに一般化したものです。
+ *
+ * @param k 自由ビットの通し番号
+ * @param fixedMask 固定ビット（ターゲット・制御ビット）のマスク
+ * @return unsigned int 固定ビットがすべて0の振幅インデックス
+ */
+inline unsigned int insertZeroBits(unsigned int k, unsigned int fixedMask){
+    while (fixedMask){
+        unsigned int low = (fixedMask & (0u - fixedMask)) - 1; // 最下位の固定ビットより下のマスク
+        k = ((k & ~low) << 1) | (k & low);
+        fixedMask &= fixedMask - 1;
+    }
+    return k;
+}
+
+/**
+ * @brief insertZeroBitsの逆変換：固定ビットを取り除いて自由ビットの通し番号を求める（pext相当）
+ *
+ * @param index 振幅インデックス
+ * @param fixedMask 固定ビットのマスク
+ * @return unsigned int 自由ビットの通し番号
+ */
+inline unsigned int extractFreeBits(unsigned int index, unsigned int fixedMask){
+    index &= ~fixedMask;
+    for (int p = 31; p >= 0; --p){ // 上位の固定ビットから詰める
+        if (fixedMask & (1u << p)){
+            unsigned int low = (1u << p) - 1;
+            index = ((index >> 1) & ~low) | (index & low);
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief 制御条件付きゲートの振幅ペア列挙情報
+ */
+struct PairSweep {
+    unsigned int fixedMask;    // 列挙しない固定ビット（ターゲット・制御ビット）
+    unsigned int controlMask;  // 制御ビットの位置
+    unsigned int controlValue; // 制御ビットが取るべき値
+    unsigned int targetBit;    // ターゲットビットの位置
+    int count;                 // 制御条件を満たすペア数
+};
+
+/**
+ * @brief 制御マスクとターゲットから振幅ペアの列挙情報を作成する
+ *
+ * @param controlOnes |1⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param controlZeros |0⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param numQubits 量子ビット数
+ * @param targetQubit 対象量子ビット番号
+ */
+inline PairSweep makePairSweep(uint32_t controlOnes, uint32_t controlZeros, int numQubits, int targetQubit){
+    PairSweep sweep;
+    // 量子ビット番号（0=最上位）を振幅インデックスのビット位置に変換
+    sweep.controlMask = 0;
+    sweep.controlValue = 0;
+    for (int q = 0; q < numQubits; ++q){
+        unsigned int bit = 1u << (numQubits-q-1);
+        if ((controlOnes | controlZeros) & (1u << q)){
+            sweep.controlMask |= bit;
+        }
+        if (controlOnes & (1u << q)){
+            sweep.controlValue |= bit;
+        }
+    }
+    sweep.targetBit = 1u << (numQubits-targetQubit-1);
+    sweep.controlMask &= ~sweep.targetBit;
+    sweep.controlValue &= ~sweep.targetBit;
+    sweep.fixedMask = sweep.controlMask | sweep.targetBit;
+
+    // 自由ビット数から演算対象のペア数を決定
+    sweep.count = 1 << (numQubits - __builtin_popcount(sweep.fixedMask));
+    return sweep;
+}
+
+/**
+ * @brief 自由ビット番号 [begin, end) の振幅ペアに演算を適用する
+ *
+ * 範囲の先頭はinsertZeroBitsで、以降は ((x | fixed) + 1) & ~fixed の
+ * 繰り上げで次のインデックスを求めます。
+ */
+template <typename Real, typename PairOp>
+inline void sweepPairRange(Real* state, const PairSweep& sweep, int begin, int end, const GateCoefficients& gate, PairOp op){
+    int om = sweep.targetBit << 1; // オフセットマスク（実部・虚部交互配列）
+    unsigned int index = insertZeroBits(begin, sweep.fixedMask); // 範囲先頭の振幅インデックス
+    for (int i = begin; i < end; ++i){
+        int i00 = (index | sweep.controlValue) << 1; // |0⟩状態ペアの実部
+        op(state, i00, i00 | om, gate);
+        index = ((index | sweep.fixedMask) + 1) & ~sweep.fixedMask; // 次の自由ビット組み合わせ
+    }
+}
+
+/**
+ * @brief ターゲットビットの全振幅ペア（制御条件を満たすもの）に演算を適用する
+ *
+ * 制御条件を満たすペアだけを直接列挙します。固定ビット（ターゲット・制御）を
+ * 除いた自由ビットの番号をスレッドで分割して処理します。
+ *
+ * @param state 量子状態ベクトル
+ * @param controlOnes |1⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param controlZeros |0⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param numQubits 量子ビット数
+ * @param targetQubit 対象量子ビット番号
+ * @param gate 演算用ゲート係数
+ * @param op ペア演算関数
+ */
+template <typename Real, typename PairOp>
+void sweepGatePairs(Real* state, uint32_t controlOnes, uint32_t controlZeros, int numQubits, int targetQubit, const GateCoefficients& gate, PairOp op){
+    const PairSweep sweep = makePairSweep(controlOnes, controlZeros, numQubits, targetQubit);
+    parallelFor(sweep.count, [&](int, int begin, int end){
+        sweepPairRange(state, sweep, begin, end, gate, op);
+    });
+}
+
+/**
+ * @brief ゲートの種類に応じた専用カーネルを選び、スイープ関数に渡す
+ *
+ * 対角・反対角行列は読み書き量を削減した専用カーネルで演算します。
+ *
+ * @param gate 演算用ゲート係数
+ * @param gateKind ゲート行列の種類（GATE_DENSE / GATE_DIAGONAL / GATE_ANTI_DIAGONAL）
+ * @param sweep スイープ関数 sweep(ペア演算関数)
+ */
+template <typename Real, typename Sweep>
+void dispatchGateKernel(const GateCoefficients& gate, int gateKind, Sweep sweep){
+    switch (gateKind){
+        case GATE_DIAGONAL:
+            if (isUnitElement(gate.t00r, gate.t00i) && isUnitElement(gate.t11r, gate.t11i)){
+                break; // 恒等行列（融合でX·X等が打ち消し合った場合）は演算不要
+            }
+            if (isUnitElement(gate.t00r, gate.t00i)){
+                sweep(applyPhasePair<Real>);
+            }else{
+                sweep(applyDiagonalPair<Real>);
+            }
+            break;
+        case GATE_ANTI_DIAGONAL:
+            if (isUnitElement(gate.t01r, gate.t01i) && isUnitElement(gate.t10r, gate.t10i)){
+                sweep(applySwapPair<Real>);
+            }else{
+                sweep(applyAntiDiagonalPair<Real>);
+            }
+            break;
+        default:
+            sweep(applyGatePair<Real>);
+            break;
+    }
+}
+
+/**
+ * @brief 対象ビットの |0⟩・|1⟩ 振幅ペアについて ρ₀₁ = Σ s₀·conj(s₁) の部分和を求める
+ *
+ * @param state 量子状態ベクトル
+ * @param begin ペア番号の開始位置
+ * @param end ペア番号の終了位置（含まない）
+ * @param om オフセットマスク
+ * @param m2 下位ビットマスク
+ * @param not_m2 上位ビットマスク
+ * @return complex<double> off-diagonal要素の部分和
+ */
+template <typename Real>
+complex<double> sumOffDiagonal(const Real* state, int begin, int end, int om, int m2, int not_m2){
+    complex<double> newDensityMatrix1 = 0;
+    for(int j = begin; j < end; ++j){
+        // インデックス計算：ビット操作で効率的に状態番号を生成
+        int i00 = (((j & not_m2) << 1) | (j & m2)) << 1; // |0⟩状態のインデックス
+        int i01 = i00 | 1; // 虚部インデックス
+        int i10 = i00 | om; // |1⟩状態のインデックス
+        int i11 = i10 | 1; // 虚部インデックス
+
+        // 状態ベクトルから複素数成分を取得
+        double s0r = state[i00]; // |0⟩の実部
+        double s0i = state[i01]; // |0⟩の虚部
+        double s1r = state[i10]; // |1⟩の実部
+        double s1i = state[i11]; // |1⟩の虚部
+
+        // 密度行列のoff-diagonal要素 ρ₀₁ = ⟨0|ρ|1⟩ を計算
+        newDensityMatrix1 += complex<double>(s0r*s1r + s0i*s1i, - s0r*s1i + s0i*s1r);
+    }
+    return newDensityMatrix1;
+}
+
+/**
+ * @brief 状態 j の確率密度 |ψⱼ|² を求める
+ *
+ * @param state 量子状態ベクトル
+ * @param j2 振幅の実部インデックス（2j）
+ */
+template <typename Real>
+inline double amplitudeNorm(const Real* state, unsigned int j2){
+    return norm(complex<double>(state[j2], state[j2 | 1]));
+}
+
+#ifdef __wasm_simd128__
+template <>
+complex<double> sumOffDiagonal<double>(const double* state, int begin, int end, int om, int m2, int not_m2){
+    // s0·s1 = (s0r·s1r, s0i·s1i) と s0·swap(s1) = (s0r·s1i, s0i·s1r) をレーンごとに累積
+    v128_t accDirect = wasm_f64x2_splat(0.0);
+    v128_t accSwap = wasm_f64x2_splat(0.0);
+    for(int j = begin; j < end; ++j){
+        int i00 = (((j & not_m2) << 1) | (j & m2)) << 1; // |0⟩状態のインデックス
+        v128_t s0 = wasm_v128_load(state + i00);
+        v128_t s1 = wasm_v128_load(state + (i00 | om));
+        accDirect = wasm_f64x2_add(accDirect, wasm_f64x2_mul(s0, s1));
+        accSwap = wasm_f64x2_add(accSwap, wasm_f64x2_mul(s0, wasm_i64x2_shuffle(s1, s1, 1, 0)));
+    }
+    return complex<double>(
+        wasm_f64x2_extract_lane(accDirect, 0) + wasm_f64x2_extract_lane(accDirect, 1),
+        wasm_f64x2_extract_lane(accSwap, 1) - wasm_f64x2_extract_lane(accSwap, 0));
+}
+
+template <>
+inline double amplitudeNorm<double>(const double* state, unsigned int j2){
+    v128_t amp = wasm_v128_load(state + j2);
+    v128_t sq = wasm_f64x2_mul(amp, amp);
+    return wasm_f64x2_extract_lane(sq, 0) + wasm_f64x2_extract_lane(sq, 1);
+}
+#endif
+
+/**
+ * @brief 1タイル（連続 2^tileBits 振幅）内のビットについて密度行列要素を累積する
+ *
+ * off-diagonal要素はタイル内の各ビットについてペア積を、diagonal要素は
+ * |ψⱼ|² を隣接ペアで畳み込みながら奇数側（ビット=1）の和を取ることで
+ * 振幅数に比例する計算量で全ビット分を求めます。
+ *
+ * @param tile タイル先頭の状態ベクトル
+ * @param tileBits タイル内のビット数
+ * @param scratch 畳み込み用作業配列（2^(tileBits-1)要素）
+ * @param offDiagonal ビット位置ごとのoff-diagonal累積値（ビット位置0 = 最下位）
+ * @param ones ビット位置ごとの |1⟩確率累積値
+ * @return double タイル内の確率の総和
+ */
+template <typename Real>
+double accumulateTraceTile(const Real* tile, int tileBits, double* scratch, complex<double>* offDiagonal, double* ones){
+    int half = 1 << (tileBits-1); // タイル内のペア数
+    for (int p = 0; p < tileBits; ++p){
+        int m = 1 << p; // 対象ビットのマスク
+        offDiagonal[p] += sumOffDiagonal(tile, 0, half, m << 1, m-1, ~(m-1));
+    }
+
+    // 最下位ビット：隣接振幅の確率を足し合わせながら奇数側を累積
+    double odd = 0.0;
+    for (int k = 0; k < half; ++k){
+        double p0 = amplitudeNorm(tile, 4*k);
+        double p1 = amplitudeNorm(tile, 4*k+2);
+        odd += p1;
+        scratch[k] = p0 + p1;
+    }
+    ones[0] += odd;
+
+    // 上位ビット：畳み込み済みの和をさらに半分に畳む
+    for (int p = 1, len = half; len > 1; ++p, len >>= 1){
+        odd = 0.0;
+        for (int k = 0; k < len/2; ++k){
+            odd += scratch[2*k+1];
+            scratch[k] = scratch[2*k] + scratch[2*k+1];
+        }
+        ones[p] += odd;
+    }
+    return scratch[0];
+}
+
 /**
  * @brief 密度行列の計算とトレース演算を行う関数
  * 
  * 量子状態ベクトルから各量子ビットの密度行列を計算し、
  * ブロッホ球表示に必要なパラメータを抽出します。
+ *
+ * 状態ベクトルを 2^TRACE_TILE_BITS 振幅のタイルに分け、1回の読み込みで
+ * タイル内の全ビットと diagonal 要素を累積します。タイルより上位のビットは
+ * 2^TRACE_RUN_BITS 振幅の連続区間を束ねたキューブ単位で off-diagonal 要素のみ求めます
+ * （14量子ビット以下は1パス、22量子ビットまでは2パス）。
+ * tileOp を指定すると各タイルを累積する直前に呼び出し、最後のゲート演算を
+ * キャッシュ上のタイルに適用してから読み込みます。
  * 
  * @param state 量子状態ベクトル（実部・虚部交互配列）
  * @param numQubits 量子ビット数
  * @param densityMatrix 出力用密度行列配列（8要素×numQubits）
+ * @param tileOp タイル処理関数 tileOp(タイル先頭の振幅インデックス, タイルのビット数)
  * 
  * densityMatrix構造:
  * [0]: |0⟩の確率、[1]: 未使用、[2,3]: off-diagonal要素の実部・虚部
  * [4,5]: off-diagonal要素の実部・虚部、[6]: |1⟩の確率、[7]: 未使用
  */
-void calculateTraceState(double* state, int numQubits, double* densityMatrix){
-    int n = 1 << numQubits; // 2^numQubits個の状態数
+template <typename Real, typename TileOp>
+void calculateTraceState(Real* state, int numQubits, double* densityMatrix, TileOp tileOp){
+    int tileBits = min(numQubits, TRACE_TILE_BITS); // タイル内のビット数
+    int tileCount = 1 << (numQubits - tileBits);    // タイル数
+    vector<complex<double>> partialOffDiagonal(MAX_THREADS * numQubits); // スレッドごとのoff-diagonal部分和
+    vector<double> partialOnes(MAX_THREADS * numQubits); // スレッドごとの|1⟩確率部分和
+    double partialTotal[MAX_THREADS] = {}; // スレッドごとの確率の総和
 
-    // 各量子ビットについて密度行列のoff-diagonal要素を計算
-    for(int i = 0; i < numQubits; ++i){
-        int n2 = 1 << (numQubits-1); // 半分の状態数
-        int m = 1 << (numQubits-i-1); // 対象ビットのマスク
-        int om = m << 1; // オフセットマスク
-        int m2 = m-1; // 下位ビットマスク
-        int not_m2 = ~m2; // 上位ビットマスク
+    // タイル単位の1パス：タイル内ビットのoff-diagonal要素と全ビットのdiagonal要素
+    int usedThreads = parallelFor(tileCount, [&](int t, int begin, int end){
+        vector<double> scratch(1 << (tileBits-1)); // 畳み込み用作業配列
+        complex<double>* offDiagonal = &partialOffDiagonal[t * numQubits];
+        double* ones = &partialOnes[t * numQubits];
+        for (int tile = begin; tile < end; ++tile){
+            unsigned int base = static_cast<unsigned int>(tile) << tileBits; // タイル先頭の振幅インデックス
+            tileOp(base, tileBits);
+            double total = accumulateTraceTile(state + 2*static_cast<size_t>(base), tileBits, scratch.data(), offDiagonal, ones);
+            partialTotal[t] += total;
+            for (int p = tileBits; p < numQubits; ++p){ // タイル番号のビットが1なら全体が|1⟩側
+                if (base & (1u << p)){
+                    ones[p] += total;
+                }
+            }
+        }
+    }, 2);
+
+    // タイルより上位のビット：キューブ単位でoff-diagonal要素を計算
+    int groupBits = TRACE_TILE_BITS - TRACE_RUN_BITS; // 1キューブで扱う上位ビット数
+    int runLength = 1 << TRACE_RUN_BITS;              // 連続して読む振幅数
+    for (int lo = tileBits; lo < numQubits; lo += groupBits){
+        int hi = min(lo + groupBits, numQubits);
+        int cubeBits = hi - lo;
+        unsigned int cubeMask = (((1u << cubeBits) - 1) << lo) | (runLength - 1); // キューブ内で動くビット
+        int cubeCount = 1 << (numQubits - TRACE_RUN_BITS - cubeBits);
+        int groupThreads = parallelFor(cubeCount, [&](int t, int begin, int end){
+            complex<double>* offDiagonal = &partialOffDiagonal[t * numQubits];
+            for (int cube = begin; cube < end; ++cube){
+                unsigned int base = insertZeroBits(cube, cubeMask); // キューブ先頭の振幅インデックス
+                for (int p = lo; p < hi; ++p){
+                    int om = 2 << p; // 対象ビットのオフセットマスク
+                    for (int run = 0; run < (1 << cubeBits); ++run){
+                        if (run & (1 << (p-lo))){
+                            continue; // 対象ビットが0の区間のみ
+                        }
+                        const Real* runState = state + 2*static_cast<size_t>(base | (static_cast<unsigned int>(run) << lo));
+                        offDiagonal[p] += sumOffDiagonal(runState, 0, runLength, om, runLength-1, ~(runLength-1));
+                    }
+                }
+            }
+        }, 2);
+        usedThreads = max(usedThreads, groupThreads);
+    }
+
+    // 部分和を集計して密度行列配列に格納（ビット位置p = numQubits-i-1）
+    double totalNorm = 0.0;
+    for (int t = 0; t < usedThreads; ++t){
+        totalNorm += partialTotal[t];
+    }
+    for (int i = 0; i < numQubits; ++i){
+        int p = numQubits-i-1;
         complex<double> newDensityMatrix1 = 0;
-        
-        // |0⟩と|1⟩の干渉項を計算
-        for(int j = 0; j < n2; ++j){
-            // インデックス計算：ビット操作で効率的に状態番号を生成
-            int i00 = (((j & not_m2) << 1) | (j & m2)) << 1; // |0⟩状態のインデックス
-            int i01 = i00 | 1; // 虚部インデックス
-            int i10 = i00 | om; // |1⟩状態のインデックス
-            int i11 = i10 | 1; // 虚部インデックス
-
-            // 状態ベクトルから複素数成分を取得
-            double s0r = state[i00]; // |0⟩の実部
-            double s0i = state[i01]; // |0⟩の虚部
-            double s1r = state[i10]; // |1⟩の実部
-            double s1i = state[i11]; // |1⟩の虚部
-            
-            // 密度行列のoff-diagonal要素 ρ₀₁ = ⟨0|ρ|1⟩ を計算
-            newDensityMatrix1 += complex<double>(s0r*s1r + s0i*s1i, - s0r*s1i + s0i*s1r);
-        }
-        // 計算結果を密度行列配列に格納
+        double one = 0.0;
+        for (int t = 0; t < usedThreads; ++t){
+            newDensityMatrix1 += partialOffDiagonal[t * numQubits + p];
+            one += partialOnes[t * numQubits + p];
+        }
+        densityMatrix[i*8] = totalNorm - one; // |0⟩確率
+        densityMatrix[i*8+1] = 0.0; // 未使用
         densityMatrix[i*8+2] = newDensityMatrix1.real(); // off-diagonal実部
         densityMatrix[i*8+3] = newDensityMatrix1.imag(); // off-diagonal虚部
-        densityMatrix[i*8+1] = 0.0; // 未使用
         densityMatrix[i*8+7] = 0.0; // 未使用
-        densityMatrix[i*8] = 0.0; // |0⟩確率（後で計算）
-    }
-
-    // 各状態の確率密度を計算してdiagonal要素を求める
-    for(unsigned int j = 0; j < n; ++j){
-        unsigned int j2 = j << 1; // インデックス調整
-        // 状態jの確率密度 |ψⱼ|²
-        complex<double> newDensityMatrix0 = norm(complex<double>(state[j2],state[j2 | 1]));
-        
-        // 各量子ビットが|0⟩状態にある確率を累積
-        for(int i = 0; i < numQubits; ++i){
-            if((~j >> (numQubits-i-1)) & 1){ // ビットiが0の場合
-                densityMatrix[i*8] += newDensityMatrix0.real();
-            }
-        }
     }
 
     // 密度行列の対称性を利用してエルミート共役要素を設定
@@ -127,6 +955,14 @@ void calculateTraceState(double* state, int numQubits, double* densityMatrix){
     }
 }
 
+/**
+ * @brief 密度行列の計算とトレース演算を行う関数（タイル処理なし）
+ */
+template <typename Real>
+void calculateTraceState(Real* state, int numQubits, double* densityMatrix){
+    calculateTraceState(state, numQubits, densityMatrix, [](unsigned int, int){});
+}
+
 /**
  * 球面座標から量子状態パラメータを計算する関数
  * 
@@ -159,10 +995,11 @@ void calculateQubitState(double theta, double phi, double* stateParams) {
  * 
  * @param floatArray 各量子ビットの角度パラメータ配列 [θ₀, φ₀, θ₁, φ₁, ...]
  * @param numQubits 量子ビット数
- * @param state 出力用量子状態ベクトル（2^numQubits × 2要素）
+ * @param state 出力用量子状態ベクトル（2^numQubits × 2要素、double または float）
  * @param stateParams 作業用状態パラメータ配列
  */
-void initialize(double* floatArray, int numQubits, double* state, double* stateParams) {
+template <typename Real>
+void initialize(double* floatArray, int numQubits, Real* state, double* stateParams) {
     size_t n = 1 << numQubits; // 2^numQubits個の状態  
 
     // 全状態を0で初期化
@@ -201,206 +1038,282 @@ void initialize(double* floatArray, int numQubits, double* state, double* stateP
  * 制御ゲートの場合は制御ビットの状態を確認してから演算を実行します。
  * 
  * @param state 量子状態ベクトル（更新対象）
- * @param ControlState 制御ゲート用のビット圧縮状態配列
- * @param newCircuit 現在の回路行のゲート配置
- * @param gatePacks 各ゲートの行列要素（8要素×6ゲート）
- * @param ncgate 特殊ゲートコード配列 [なし, 制御0, 制御1]
- * @param gateOffset ゲートパック内のオフセット
+ * @param pack ゲート行列要素（8要素、gatePacks内または融合済み行列）
+ * @param gateKind ゲート行列の種類（GATE_DENSE / GATE_DIAGONAL / GATE_ANTI_DIAGONAL）
+ * @param controlOnes |1⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param controlZeros |0⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
  * @param numQubits 量子ビット数
- * @param w 回路内の行番号
  * @param targetQubit 対象量子ビット番号
  */
-void calculateState(double* state, uint64_t* ControlState, int* newCircuit, double* gatePacks, int* ncgate, int gateOffset, int numQubits, int w, int targetQubit){    int n = 1 << (numQubits-1); // 演算対象の状態ペア数
-    int m = 1 << (numQubits-targetQubit-1); // ターゲットビット用マスク
-    int om = m << 1; // オフセットマスク
-    int m2 = m-1; // 下位ビットマスク
-    int not_m2 = ~m2; // 上位ビットマスク
+template <typename Real>
+void calculateState(Real* state, const double* pack, int gateKind, uint32_t controlOnes, uint32_t controlZeros, int numQubits, int targetQubit){
+    countGateSweep(numQubits, controlOnes | controlZeros);
 
     // ゲート行列の要素を取得（2×2複素行列）
-    double t00r = gatePacks[gateOffset];     // T₀₀の実部
-    double t01r = gatePacks[gateOffset+2];   // T₀₁の実部
-    double t10r = gatePacks[gateOffset+4];   // T₁₀の実部
-    double t11r = gatePacks[gateOffset+6];   // T₁₁の実部
-    double t00i = gatePacks[gateOffset+1];   // T₀₀の虚部
-    double t01i = gatePacks[gateOffset+3];   // T₀₁の虚部
-    double t10i = gatePacks[gateOffset+5];   // T₁₀の虚部
-    double t11i = gatePacks[gateOffset+7];   // T₁₁の虚部
-
-    // 制御ゲートが存在するかチェック
-    bool controlbit = false;
-    for(int i = 0; i < numQubits; ++i){ // 制御ゲート検査
-        if(newCircuit[numQubits*w+i]==ncgate[1] || newCircuit[numQubits*w+i]==ncgate[2]){
-            controlbit = true;
-            break;
-        }
-    }
-    
-    if (controlbit){
-        // 制御ゲートの場合：制御状態に応じたビット圧縮処理
-        
-        // ビット圧縮形式のControlState配列を初期化
-        int controlValue = ceil((1<<(numQubits-1))/64); // 必要な64bit配列数
-        for(int i=0; i<controlValue;++i){
-            ControlState[i] = 0;
-        }
-        ControlState[0] = 1; // 初期値設定
-
-        int count = 0;
-        // 制御ビットパターンを構築
-        for (int j = 0; j < numQubits; ++j) {
-            if (j != targetQubit) { // ターゲットビットは制御から除外
-                int newCircuitgate = newCircuit[numQubits*w+j];
-                bool control0 = !(newCircuitgate == ncgate[1]); // 制御ビット0の条件
-                bool control1 = !(newCircuitgate == ncgate[2]); // 制御ビット1の条件
-
-                // 制御状態を段階的に更新
-                const int oldLen = 1 << count;
-                for (int f = oldLen - 1; f >= 0; --f) { // 上位ビットから操作
-                    int block = f / 64; // 64bit配列のブロック番号
-                    int bit = f % 64;   // ブロック内のビット位置
-
-                    if (ControlState[block] & (1ULL << bit)){
-                        int newIndex0 = 2 * f;     // 制御ビット0の新インデックス
-                        int newIndex1 = 2 * f + 1; // 制御ビット1の新インデックス
-
-                        if (control0) { // 制御ビットが0の場合に更新
-                            int block0 = newIndex0 / 64;
-                            int bit0 = newIndex0 % 64;
-                            ControlState[block0] |= (1ULL << bit0);
-                        }
-                        if (control1) { // 制御ビットが1の場合に更新
-                            int block1 = newIndex1 / 64;
-                            int bit1 = newIndex1 % 64;
-                            ControlState[block1] |= (1ULL << bit1);
-                        }
-                    }
+    const GateCoefficients gate = loadGateCoefficients(pack);
 
-                    // 元のビットをクリア（制御ビット更新エラーを防止）
-                    if (f || !control0){
-                        ControlState[block] &= ~(1ULL << bit);
-                    }
-                }
-                count++;
+    // ゲートの種類に応じた専用カーネルで全振幅ペアを演算
+    dispatchGateKernel<Real>(gate, gateKind, [&](auto op){
+        sweepGatePairs(state, controlOnes, controlZeros, numQubits, targetQubit, gate, op);
+    });
+}
+
+/**
+ * @brief 実部・虚部を別配列に分けた状態ベクトル（SoAレイアウト、boolShared ビット5）
+ *
+ * 共有メモリの状態ベクトル領域の前半 2^numQubits 要素に実部、後半に虚部を格納します。
+ * 振幅ペアの更新が連続要素どうしの演算になり、シャッフルなしでSIMD化できます。
+ */
+template <typename Real>
+struct SplitState {
+    Real* re; // 実部配列
+    Real* im; // 虚部配列
+};
+
+/**
+ * @brief 状態ベクトルの保存領域の先頭（チェックポイントのコピーに使用）
+ */
+template <typename Real>
+inline Real* stateData(Real* state){ return state; }
+
+template <typename Real>
+inline Real* stateData(SplitState<Real> state){ return state.re; }
+
+/**
+ * @brief 自由ビット番号 [begin, end) を、振幅インデックスが連続する区間ごとに処理する
+ *
+ * 最下位の固定ビットより下の自由ビットは振幅インデックスでも連続するため、
+ * 区間内は実部・虚部配列の連続要素に対する単純なループになります。
+ *
+ * @param fixedMask 固定ビットのマスク（0以外）
+ * @param fixedValue 振幅インデックスに加える固定ビットの値（制御条件）
+ * @param begin 自由ビット番号の開始
+ * @param end 自由ビット番号の終了（含まない）
+ * @param fn 区間処理関数 fn(先頭振幅インデックス, 振幅数)
+ */
+template <typename RunOp>
+inline void forEachContiguousRun(unsigned int fixedMask, unsigned int fixedValue, int begin, int end, RunOp fn){
+    int runLength = static_cast<int>(fixedMask & (0u - fixedMask)); // 最下位の固定ビット = 連続区間の長さ
+    for (int k = begin; k < end; ){
+        int length = min(end - k, runLength - (k & (runLength - 1)));
+        fn(insertZeroBits(k, fixedMask) | fixedValue, length);
+        k += length;
+    }
+}
+
+/**
+ * @brief SoAレイアウトの連続区間 [i0, i0+length) とそのペア [i1, i1+length) にゲートを適用する
+ *
+ * 区間長はターゲットビット以下のため、2つの区間は重なりません。
+ */
+template <typename Real>
+inline void applySplitGateRun(Real* re, Real* im, unsigned int i0, unsigned int i1, int length, const GateCoefficients& g, int gateKind){
+    Real* __restrict ar = re + i0;
+    Real* __restrict ai = im + i0;
+    Real* __restrict br = re + i1;
+    Real* __restrict bi = im + i1;
+    const double t00r = g.t00r, t00i = g.t00i, t01r = g.t01r, t01i = g.t01i;
+    const double t10r = g.t10r, t10i = g.t10i, t11r = g.t11r, t11i = g.t11i;
+
+    if (gateKind == GATE_DIAGONAL){
+        if (!isUnitElement(t00r, t00i)){
+            for (int j = 0; j < length; ++j){
+                double r = ar[j], i = ai[j];
+                ar[j] = static_cast<Real>(t00r*r - t00i*i);
+                ai[j] = static_cast<Real>(t00r*i + t00i*r);
             }
         }
-
-        // 制御条件を満たす状態にのみゲート演算を適用
-        for (int i = 0; i < n; ++i){
-            int block = i / 64;
-            int bit = i % 64;
-            if (ControlState[block] & (1ULL << bit)) { // 制御状態が有効な場合のみ処理
-                // インデックス計算：効率的なビット操作で状態番号を生成
-                int i00 = (((i & not_m2) << 1) | (i & m2)) <<1; // |0⟩状態ペアの実部
-                int i01 = i00 | 1;  // |0⟩状態ペアの虚部
-                int i10 = i00 | om; // |1⟩状態ペアの実部
-                int i11 = i10 | 1;  // |1⟩状態ペアの虚部
-
-                // 現在の状態ベクトル要素を取得
-                double s0r = state[i00]; // |0⟩の実部
-                double s0i = state[i01]; // |0⟩の虚部
-                double s1r = state[i10]; // |1⟩の実部
-                double s1i = state[i11]; // |1⟩の虚部
-
-                // 行列演算：新しい状態 = ゲート行列 × 現在の状態
-                state[i00] = s0r*t00r + s1r*t01r - s0i*t00i - s1i*t01i;
-                state[i01] = s0r*t00i + s1r*t01i + s0i*t00r + s1i *t01r;
-                state[i10] = s0r*t10r + s1r*t11r - s0i* t10i - s1i*t11i;
-                state[i11] = s0r*t10i + s1r*t11i + s0i*t10r + s1i*t11r;
+        if (!isUnitElement(t11r, t11i)){
+            for (int j = 0; j < length; ++j){
+                double r = br[j], i = bi[j];
+                br[j] = static_cast<Real>(t11r*r - t11i*i);
+                bi[j] = static_cast<Real>(t11r*i + t11i*r);
             }
         }
+    }else if (gateKind == GATE_ANTI_DIAGONAL){
+        for (int j = 0; j < length; ++j){
+            double r0 = ar[j], i0 = ai[j], r1 = br[j], i1 = bi[j];
+            ar[j] = static_cast<Real>(t01r*r1 - t01i*i1);
+            ai[j] = static_cast<Real>(t01r*i1 + t01i*r1);
+            br[j] = static_cast<Real>(t10r*r0 - t10i*i0);
+            bi[j] = static_cast<Real>(t10r*i0 + t10i*r0);
+        }
     }else{
-        // 非制御ゲートの場合：全状態にゲート演算を適用
-        for (int i = 0; i < n; ++i){
-            // インデックス計算
-            int i00 = (((i & not_m2) << 1) | (i & m2)) << 1;
-            int i01 = i00 | 1;
-            int i10 = i00 | om;
-            int i11 = i10 | 1;
+        for (int j = 0; j < length; ++j){
+            double r0 = ar[j], i0 = ai[j], r1 = br[j], i1 = bi[j];
+            ar[j] = static_cast<Real>(t00r*r0 - t00i*i0 + t01r*r1 - t01i*i1);
+            ai[j] = static_cast<Real>(t00r*i0 + t00i*r0 + t01r*i1 + t01i*r1);
+            br[j] = static_cast<Real>(t10r*r0 - t10i*i0 + t11r*r1 - t11i*i1);
+            bi[j] = static_cast<Real>(t10r*i0 + t10i*r0 + t11r*i1 + t11i*r1);
+        }
+    }
+}
+
+/**
+ * @brief SoAレイアウトの状態ベクトルにゲートを適用する
+ *
+ * 引数は calculateState(Real*, ...) と同じです。
+ */
+template <typename Real>
+void calculateState(SplitState<Real> state, const double* pack, int gateKind, uint32_t controlOnes, uint32_t controlZeros, int numQubits, int targetQubit){
+    const GateCoefficients gate = loadGateCoefficients(pack);
+    if (gateKind == GATE_DIAGONAL && isUnitElement(gate.t00r, gate.t00i) && isUnitElement(gate.t11r, gate.t11i)){
+        return; // 単位行列
+    }
+    countGateSweep(numQubits, controlOnes | controlZeros);
+    const PairSweep sweep = makePairSweep(controlOnes, controlZeros, numQubits, targetQubit);
+    parallelFor(sweep.count, [&](int, int begin, int end){
+        forEachContiguousRun(sweep.fixedMask, sweep.controlValue, begin, end, [&](unsigned int i0, int length){
+            applySplitGateRun(state.re, state.im, i0, i0 | sweep.targetBit, length, gate, gateKind);
+        });
+    });
+}
 
-            // 状態ベクトル要素を取得
-            double s0r = state[i00];
-            double s0i = state[i01];
-            double s1r = state[i10];
-            double s1i = state[i11];
+/**
+ * @brief SoAレイアウトの連続区間ペアについて、|0⟩側の確率とoff-diagonal要素を累積する
+ *
+ * @param zeros |0⟩側の確率 Σ|a₀|² の累積先
+ * @param offDiagonal off-diagonal要素 Σ a₀·conj(a₁) の累積先
+ */
+template <typename Real>
+inline void accumulateSplitPairs(const Real* re, const Real* im, unsigned int i0, unsigned int i1, int length, double& zeros, complex<double>& offDiagonal){
+    double z = 0.0, offRe = 0.0, offIm = 0.0;
+    for (int j = 0; j < length; ++j){
+        double ar = re[i0+j], ai = im[i0+j], br = re[i1+j], bi = im[i1+j];
+        z += ar*ar + ai*ai;
+        offRe += ar*br + ai*bi;
+        offIm += ai*br - ar*bi;
+    }
+    zeros += z;
+    offDiagonal += complex<double>(offRe, offIm);
+}
 
-            // 行列演算を適用
-            state[i00] = s0r*t00r + s1r*t01r - s0i*t00i - s1i*t01i;
-            state[i01] = s0r*t00i + s1r*t01i + s0i*t00r + s1i *t01r;
-            state[i10] = s0r*t10r + s1r*t11r - s0i* t10i - s1i*t11i;
-            state[i11] = s0r*t10i + s1r*t11i + s0i*t10r + s1i*t11r;
-        }
+#ifdef __wasm_simd128__
+// SIMD128版：2振幅ずつ f64x2 で累積
+template <>
+inline void accumulateSplitPairs<double>(const double* re, const double* im, unsigned int i0, unsigned int i1, int length, double& zeros, complex<double>& offDiagonal){
+    v128_t z = wasm_f64x2_splat(0.0), offRe = z, offIm = z;
+    int j = 0;
+    for (; j + 2 <= length; j += 2){
+        v128_t ar = wasm_v128_load(re + i0 + j), ai = wasm_v128_load(im + i0 + j);
+        v128_t br = wasm_v128_load(re + i1 + j), bi = wasm_v128_load(im + i1 + j);
+        z = wasm_f64x2_add(z, wasm_f64x2_add(wasm_f64x2_mul(ar, ar), wasm_f64x2_mul(ai, ai)));
+        offRe = wasm_f64x2_add(offRe, wasm_f64x2_add(wasm_f64x2_mul(ar, br), wasm_f64x2_mul(ai, bi)));
+        offIm = wasm_f64x2_add(offIm, wasm_f64x2_sub(wasm_f64x2_mul(ai, br), wasm_f64x2_mul(ar, bi)));
+    }
+    double sumZ = wasm_f64x2_extract_lane(z, 0) + wasm_f64x2_extract_lane(z, 1);
+    double sumRe = wasm_f64x2_extract_lane(offRe, 0) + wasm_f64x2_extract_lane(offRe, 1);
+    double sumIm = wasm_f64x2_extract_lane(offIm, 0) + wasm_f64x2_extract_lane(offIm, 1);
+    for (; j < length; ++j){ // 奇数長の残り
+        double ar = re[i0+j], ai = im[i0+j], br = re[i1+j], bi = im[i1+j];
+        sumZ += ar*ar + ai*ai;
+        sumRe += ar*br + ai*bi;
+        sumIm += ai*br - ar*bi;
     }
+    zeros += sumZ;
+    offDiagonal += complex<double>(sumRe, sumIm);
 }
+#endif
 
 /**
- * 回路データから実行可能な行列形式に変換する関数
- * 
- * 1行分の回路データを解析し、同時実行可能なゲート群を抽出して
- * 新しい行列形式に再構成します。制御ゲートとターゲットゲートの
- * 関係を適切に処理します。
- * 
- * @param circuitData 元の回路データ（numQubits × 回路長）
- * @param newCircuit 出力用の新しい回路行列（21×21の作業領域）
- * @param ncgate 特殊ゲートコード [なし, 制御0, 制御1]
- * @param a 処理対象の行番号
+ * @brief SoAレイアウトの状態ベクトルから各量子ビットの密度行列を計算する
+ *
+ * タイル（2^TRACE_TILE_BITS 振幅）内のビットはタイルごとにキャッシュ上でまとめて集計し、
+ * タイルより上位のビットはビットごとに状態ベクトルを1回走査します。
+ * 密度行列の格納形式は calculateTraceState(Real*, ...) と同じです。
+ *
+ * @param state 量子状態ベクトル（SoAレイアウト）
  * @param numQubits 量子ビット数
+ * @param densityMatrix 密度行列結果配列（8要素×numQubits）
  */
-void constructNewMatrix(int* circuitData, int* newCircuit, int* ncgate, int a, int numQubits) {
+template <typename Real>
+void calculateTraceState(SplitState<Real> state, int numQubits, double* densityMatrix){
+    int size = 1 << numQubits;
+    int tileBits = min(numQubits, TRACE_TILE_BITS);
+    vector<double> partialZeros(MAX_THREADS * numQubits, 0.0);
+    vector<complex<double>> partialOffDiagonal(MAX_THREADS * numQubits, 0.0);
 
-    bool hasNonZeroOrNine = false; // 制御ゲートの存在フラグ
-    bool noneCircuit = false;      // 空回路フラグ
+    auto accumulateBit = [&](int thread, int p, int begin, int end){
+        unsigned int bit = 1u << p;
+        forEachContiguousRun(bit, 0, begin, end, [&](unsigned int i0, int length){
+            accumulateSplitPairs(state.re, state.im, i0, i0 | bit, length,
+                                 partialZeros[thread * numQubits + p], partialOffDiagonal[thread * numQubits + p]);
+        });
+    };
 
-    // 制御ゲート（ncgate[1], ncgate[2]）が存在するかチェック
-    if (find(circuitData + a * numQubits, circuitData + (a + 1) * numQubits, ncgate[1]) != circuitData + (a + 1) * numQubits || 
-        find(circuitData + a * numQubits, circuitData + (a + 1) * numQubits, ncgate[2]) != circuitData + (a + 1) * numQubits) {
-        hasNonZeroOrNine = true; // コントロールゲート検出
-    }
+    // タイル内のビット（ペア番号 tile·2^(tileBits-1) 〜 がタイル内の振幅に対応）
+    int tilePairs = 1 << (tileBits - 1);
+    parallelFor(size >> tileBits, [&](int thread, int begin, int end){
+        for (int tile = begin; tile < end; ++tile){
+            for (int p = 0; p < tileBits; ++p){
+                accumulateBit(thread, p, tile * tilePairs, (tile + 1) * tilePairs);
+            }
+        }
+    }, 1);
 
-    // ゲートなしまたはコントロールゲートのみかチェック
-    if (std::all_of(circuitData + a * numQubits, circuitData + (a + 1) * numQubits,
-            [&ncgate](int value) { return find(ncgate, ncgate + 3, value) != ncgate + 3; })) {
-        noneCircuit = true;
+    // タイルより上位のビット
+    for (int p = tileBits; p < numQubits; ++p){
+        parallelFor(size >> 1, [&](int thread, int begin, int end){
+            accumulateBit(thread, p, begin, end);
+        });
     }
 
-    // ターゲットビット（実際にゲートが配置されたビット）をビットマスクで管理
-    uint64_t targetIndices = 0;
-    int count = 0;
-    for (int k = 0; k < numQubits; ++k) {
-        if (circuitData[a*numQubits+k] != ncgate[0] && 
-            circuitData[a*numQubits+k] != ncgate[1] && 
-            circuitData[a*numQubits+k] != ncgate[2]) {
-            targetIndices |= (1ULL << k); // ターゲットビットをマーク
-            ++count;
+    // 部分和を集計して密度行列配列に格納（ビット位置p = numQubits-i-1）
+    for (int i = 0; i < numQubits; ++i){
+        int p = numQubits-i-1;
+        double zeros = 0.0;
+        complex<double> offDiagonal = 0;
+        for (int t = 0; t < MAX_THREADS; ++t){
+            zeros += partialZeros[t * numQubits + p];
+            offDiagonal += partialOffDiagonal[t * numQubits + p];
         }
+        densityMatrix[i*8] = zeros;                   // |0⟩確率
+        densityMatrix[i*8+1] = 0.0;                   // 未使用
+        densityMatrix[i*8+2] = offDiagonal.real();    // off-diagonal実部
+        densityMatrix[i*8+3] = offDiagonal.imag();    // off-diagonal虚部
+        densityMatrix[i*8+4] = offDiagonal.real();    // ρ₁₀ = ρ₀₁*
+        densityMatrix[i*8+5] = -offDiagonal.imag();   // 虚部は符号反転
+        densityMatrix[i*8+6] = 1 - zeros;             // |1⟩確率 = 1 - |0⟩確率
+        densityMatrix[i*8+7] = 0.0;                   // 未使用
     }
+}
 
-    // 新しい回路行列を初期化
-    for (int i=0;i<21*21;++i){
-        newCircuit[i] = 0;
-    }
-    
-    if(!noneCircuit){
-        // 新しい行列を構築：ターゲットゲートを順序よく配置
-        for (size_t row = 0; row < 21; ++row) {
-            if (targetIndices & (1ULL << row)){ // このビットがターゲットの場合
-                --count;
-                newCircuit[numQubits*count+row] = circuitData[a*numQubits+row]; // ターゲット値を設定
-
-                if (hasNonZeroOrNine) { // コントロールゲートがある場合
-                    // 同じ行に制御ビットの情報も追加
-                    for (size_t j = 0; j < numQubits; ++j) {
-                        if (circuitData[a*numQubits+j] == ncgate[1]) {
-                            newCircuit[numQubits*count+j] = ncgate[1]; // 制御0を設定
-                        } else if (circuitData[a*numQubits+j] == ncgate[2]) {
-                            newCircuit[numQubits*count+j] = ncgate[2]; // 制御1を設定
-                        }
-                    }
-                }
-            }
+/**
+ * @brief SoAレイアウトの量子状態を初期化する（各量子ビットの状態のテンソル積）
+ *
+ * 引数は initialize(double*, int, Real*, double*) と同じです。
+ */
+template <typename Real>
+void initialize(double* floatArray, int numQubits, SplitState<Real> state, double* stateParams) {
+    size_t n = static_cast<size_t>(1) << numQubits;
+    fill(state.re, state.re + n, Real(0));
+    fill(state.im, state.im + n, Real(0));
+    state.re[0] = 1.0; // |00...0⟩ = 1 + 0i
+
+    for (int i = 0; i < numQubits; ++i) {
+        calculateQubitState(floatArray[2 * i], floatArray[2 * i + 1], stateParams);
+
+        // 新しいインデックスjの振幅 = 旧インデックス j/2 の振幅 × (|0⟩ または |1⟩ 成分)
+        for (int j = (1 << (i + 1)) - 1; j >= 0; --j) {
+            double r = state.re[j >> 1], im = state.im[j >> 1];
+            double cr = (j & 1) ? stateParams[2] : stateParams[0];
+            double ci = (j & 1) ? stateParams[3] : stateParams[1];
+            state.re[j] = static_cast<Real>(r*cr - im*ci);
+            state.im[j] = static_cast<Real>(r*ci + im*cr);
         }
     }
 }
 
+/**
+ * @brief 演算リスト（circuitOps）の1演算当たりの要素数
+ *
+ * 演算リストはJavaScript側（funcqcal.js の generateCircuitOps）で回路データから1回だけ作成します。
+ * 配置：[行数R, 各行の先頭演算番号 ×(R+1), 演算 ×演算数]
+ * 演算：[ターゲットビット, ゲート番号（gatePacks内の位置 0~5）, 制御（|1⟩条件）マスク, 制御（|0⟩条件）マスク]
+ * マスクはビットq = 量子ビットqで、同じ行の演算は量子ビット番号の降順に並びます。
+ */
+const int CIRCUIT_OP_SIZE = 4;
+
 /**
  * 各種量子ゲートの行列要素を事前計算する関数
  * 
@@ -410,13 +1323,14 @@ void constructNewMatrix(int* circuitData, int* newCircuit, int* ncgate, int a, i
  * @param theta 回転角パラメータ（ラジアン）
  * @param gatePacks 出力用ゲート行列配列（8要素×6ゲート）
  * @param gates ゲートID配列
+ * @param gateKinds 出力用ゲート種類配列（6ゲート、calculateStateのカーネル選択に使用）
  * 
  * 格納されるゲート：
  * - X, Y, Z: パウリゲート（θパラメータ化）
  * - S, T: 位相ゲート
  * - H: アダマールゲート（θパラメータ化）
  */
-void calculatGateState(double theta, double* gatePacks, int* gates) {
+void calculatGateState(double theta, double* gatePacks, int* gates, int* gateKinds) {
     double cosHalf = cos(theta/2); // cos(θ/2)
     double sinHalf = sin(theta/2); // sin(θ/2)
 
@@ -486,232 +1400,2620 @@ void calculatGateState(double theta, double* gatePacks, int* gates) {
     gatePacks[46] = cosHalf*cosHalf-sinHalf*sinHalf/sqrt(2);      // |11| 要素
     gatePacks[47] = cosHalf*sinHalf*(1+1/sqrt(2));                // 虚部成分
     gates[5] = 104;
+
+    // 各ゲート行列を対角・反対角・一般行列に分類（θにより種類が変わるため毎回判定）
+    for (int i = 0; i < 6; ++i){
+        gateKinds[i] = classifyGatePack(gatePacks + i*8);
+    }
 }
 
+
 /**
- * @brief ターゲットビット（実際のゲートが配置されたビット）を検索する関数
- * 
- * 指定された回路行の中から、制御ビットでもなしビットでもない
- * 実際のゲートが配置されたターゲットビットを見つけます。
- * 
- * @param newCircuit 新しい回路行列
- * @param numQubits 量子ビット数
- * @param row 検索対象の行番号
- * @param ncgate 特殊ゲートコード配列 [なし, 制御0, 制御1]
- * @return int ターゲットビットの番号
- */
-int findTargetQubit(int* newCircuit, int numQubits, int row, int* ncgate){
-    int targetQubit = 0;
-    // ターゲットビットの算出：制御ビットでもなしビットでもないビットを探す
-    for (int i= 0; i < numQubits; ++i) {
-        if (newCircuit[numQubits*row+i]!=ncgate[0] && newCircuit[numQubits*row+i]!=ncgate[1] && newCircuit[numQubits*row+i]!=ncgate[2]) {
-            targetQubit = i;
-            break;
+ * @brief 同一ターゲットの連続ゲートを融合する際に遡って探索する最大ゲート数
+ */
+const int FUSION_WINDOW = 64;
+
+/**
+ * @brief 融合待ちの単一量子ビットゲート（制御条件付き）
+ */
+struct FusedGate {
+    int targetQubit;       // 対象量子ビット番号
+    uint32_t controlOnes;  // |1⟩を条件とする制御ビットのマスク
+    uint32_t controlZeros; // |0⟩を条件とする制御ビットのマスク
+    double pack[8];        // 融合済みの2×2複素行列（gatePacksと同じ並び）
+    int kind;              // 行列の種類（GATE_DENSE / GATE_DIAGONAL / GATE_ANTI_DIAGONAL）
+};
+
+static vector<FusedGate> fusionQueue; // 1回の呼び出しで実行するゲート列
+
+/**
+ * @brief 2×2複素行列の積 result = a × b を計算する（gatePacksと同じ並び）
+ */
+void multiplyGatePacks(const double* a, const double* b, double* result){
+    double product[8];
+    for (int r = 0; r < 2; ++r){
+        for (int c = 0; c < 2; ++c){
+            double re = 0.0, im = 0.0;
+            for (int k = 0; k < 2; ++k){
+                double ar = a[(r*2+k)*2], ai = a[(r*2+k)*2+1];
+                double br = b[(k*2+c)*2], bi = b[(k*2+c)*2+1];
+                re += ar*br - ai*bi;
+                im += ar*bi + ai*br;
+            }
+            product[(r*2+c)*2] = re;
+            product[(r*2+c)*2+1] = im;
         }
     }
-    return targetQubit;
+    copy(product, product + 8, result);
 }
 
 /**
- * @brief ゲート行列のオフセット位置を計算する関数
- * 
- * ターゲットビットに配置されたゲートのIDから、gatePacks配列内の
- * 対応する行列要素の開始オフセットを計算します。
- * 
- * @param newCircuit 新しい回路行列
- * @param numQubits 量子ビット数
- * @param row 対象の行番号
- * @param gates ゲートID配列
- * @param targetQubit ターゲットビット番号
- * @return int gatePacks配列内のオフセット（8要素単位）
+ * @brief 2つのゲートが可換（実行順を入れ替え可能）かを判定する
+ *
+ * ターゲットが異なり、互いのターゲットを制御ビットに含まない場合に可換です。
  */
-int calculateGateOffset(int* newCircuit, int numQubits, int row, int* gates, int targetQubit){
-    int gateOffset = 0;
+inline bool gatesCommute(const FusedGate& a, const FusedGate& b){
+    return a.targetQubit != b.targetQubit &&
+        !((b.controlOnes | b.controlZeros) & (1u << a.targetQubit)) &&
+        !((a.controlOnes | a.controlZeros) & (1u << b.targetQubit));
+}
 
-    // ターゲットビットのゲートIDを特定してオフセットを計算
-    for (size_t i = 0; i < 6; ++i) {
-        if (newCircuit[numQubits*row+targetQubit] == gates[i]) {
-            gateOffset = i*8; // 各ゲートは8要素（2×2複素行列）
+/**
+ * @brief ゲートを実行待ち列に追加し、可能なら既存のゲートと融合する
+ *
+ * 待ち列を後ろから遡り、可換なゲートを飛び越えて同じターゲット・同じ制御条件の
+ * ゲートが見つかれば行列積で1つにまとめます（T連鎖などを1回のスイープにする）。
+ *
+ * @param queue 実行待ちのゲート列
+ * @param gate 追加するゲート
+ */
+void pushFusedGate(vector<FusedGate>& queue, const FusedGate& gate){
+    int limit = max(0, static_cast<int>(queue.size()) - FUSION_WINDOW);
+    for (int k = static_cast<int>(queue.size()) - 1; k >= limit; --k){
+        FusedGate& previous = queue[k];
+        if (previous.targetQubit == gate.targetQubit &&
+            previous.controlOnes == gate.controlOnes &&
+            previous.controlZeros == gate.controlZeros){
+            multiplyGatePacks(gate.pack, previous.pack, previous.pack); // 後のゲート × 前のゲート
+            previous.kind = classifyGatePack(previous.pack);
+            return;
+        }
+        if (!gatesCommute(previous, gate)){
             break;
         }
     }
-    return gateOffset;
+    queue.push_back(gate);
 }
 
+/**
+ * @brief ゲートを密度行列計算のタイル処理に融合できるか判定する
+ *
+ * ターゲットビットがタイル内にあれば振幅ペアはタイルをまたがないため、
+ * タイルごとにゲートを適用した直後にキャッシュ上で密度行列を累積できます。
+ */
+inline bool fitsTraceTile(const FusedGate& gate, int numQubits){
+    return numQubits - gate.targetQubit - 1 < min(numQubits, TRACE_TILE_BITS);
+}
 
 /**
- * @brief 量子状態演算のメイン実行関数
- * 
- * 量子回路全体を実行し、各ステップで状態を更新します。
- * プログレッシブ実行、リピート実行、部分実行などの制御機能も提供します。
- * 
- * @param state 量子状態ベクトル（更新対象）
+ * @brief 1タイル（連続 2^tileBits 振幅）内の振幅ペアにのみゲートを適用する
+ *
+ * @param state 量子状態ベクトル
+ * @param fused 適用するゲート（fitsTraceTileを満たすこと）
  * @param numQubits 量子ビット数
- * @param gates ゲートID配列
- * @param gatePacks ゲート行列要素配列
- * @param circuitData 回路データ配列
- * @param cutint 実行制御パラメータ（0=通常実行、>0=部分実行）
- * @param resultShared 結果共有配列
- * @param progressShared プログレス共有変数
- * @param boolShared 制御フラグ配列
- * @param floatArray 初期状態パラメータ配列
- * @param lengthint 回路データ長
- * @param stateParams 状態パラメータ作業配列
- * @param ControlState 制御状態ビット配列
- * @param newCircuit 新しい回路行列（作業領域）
- * @param densityMatrix 密度行列結果配列
- * @param ncgate 特殊ゲートコード配列
+ * @param base タイル先頭の振幅インデックス
+ * @param tileBits タイル内のビット数
  */
-void calculateMainState(
-    double* state,
-    int numQubits,
-    int* gates,
-    double* gatePacks,
-    int* circuitData,
-    int cutint,
-    double* resultShared,
-    int* progressShared,
-    uint64_t* boolShared,
-    double* floatArray,
-    int lengthint,
-    double* stateParams,
-    uint64_t* ControlState,
-    int* newCircuit,
-    double* densityMatrix,
-    int* ncgate){
+template <typename Real>
+void applyFusedGateToTile(Real* state, const FusedGate& fused, int numQubits, unsigned int base, int tileBits){
+    const PairSweep sweep = makePairSweep(fused.controlOnes, fused.controlZeros, numQubits, fused.targetQubit);
+    unsigned int tileMask = (1u << tileBits) - 1;
+    if ((base ^ sweep.controlValue) & sweep.controlMask & ~tileMask){
+        return; // タイル番号のビットが制御条件を満たさない
+    }
+    int begin = extractFreeBits(base, sweep.fixedMask); // タイル内の先頭ペア番号
+    int count = 1 << (tileBits - __builtin_popcount(sweep.fixedMask & tileMask));
+    const GateCoefficients gate = loadGateCoefficients(fused.pack);
+    dispatchGateKernel<Real>(gate, fused.kind, [&](auto op){
+        sweepPairRange(state, sweep, begin, begin + count, gate, op);
+    });
+}
 
-    // 実行制御パラメータの初期化
-    int lows = lengthint / numQubits;      // 回路の行数
-    int nowRepeatNumber = 0;               // 現在のリピート番号
-    int calculateLows = lows;              // 計算する行数
-    int repeatNumber = 1;                  // リピート回数
-    int nowRows = 0;                       // 現在の行番号
-    int maxProgress = (cutint == 0 ? 1 : cutint) * lows; // 最大プログレス値
-    
-    // プログレッシブ実行とリピート制御の設定
-    if (cutint != 0 && *boolShared & (1ULL << 2)){
-        if (*boolShared & (1ULL << 3)){
-            repeatNumber = cutint;         // 全リピートを実行
-        }else{
-            calculateLows = 1;             // 1行ずつ実行
-            nowRepeatNumber = *progressShared % cutint;            nowRows = *progressShared / cutint;
+/**
+ * @brief 2つの量子ビットの並びを入れ替える（SWAPゲート）
+ *
+ * @param state 量子状態ベクトル
+ * @param numQubits 量子ビット数
+ * @param qubitA 入れ替える量子ビット番号
+ * @param qubitB 入れ替える量子ビット番号
+ */
+template <typename Real>
+void swapQubits(Real* state, int numQubits, int qubitA, int qubitB){
+    unsigned int bitA = 1u << (numQubits - qubitA - 1);
+    unsigned int bitB = 1u << (numQubits - qubitB - 1);
+    countPhase(COUNTER_SWAPS, 1);
+    parallelFor(1 << (numQubits - 2), [&](int, int begin, int end){
+        for (int k = begin; k < end; ++k){
+            unsigned int base = insertZeroBits(k, bitA | bitB);
+            int iA = (base | bitA) << 1; // 量子ビットAのみ|1⟩の振幅の実部
+            int iB = (base | bitB) << 1; // 量子ビットBのみ|1⟩の振幅の実部
+            swap(state[iA], state[iB]);
+            swap(state[iA + 1], state[iB + 1]);
         }
+    });
+}
+
+/**
+ * @brief 量子ビット番号のマスクを状態ベクトル上の位置のマスクに変換する
+ */
+inline uint32_t mapQubitMask(uint32_t mask, const int* position){
+    uint32_t mapped = 0;
+    for (; mask; mask &= mask - 1){
+        mapped |= 1u << position[__builtin_ctz(mask)];
     }
+    return mapped;
+}
 
-    // メイン実行ループ：回路の各行を処理
-    for(int a=0; a<calculateLows; ++a){
-        // 新しい行を処理する場合のみ回路を分解
-        if (nowRepeatNumber == 0){
-            int calcRows = nowRows == 0 ? a : nowRows;
-            constructNewMatrix(circuitData, newCircuit, ncgate, calcRows, numQubits); // 1行ずつ回路を分解
-        }
+/**
+ * @brief 状態ベクトル上の量子ビット位置がゲートブロック内（下位 GATE_BLOCK_BITS ビット）か判定する
+ */
+inline bool inGateBlock(int qubit, int numQubits){
+    return numQubits - qubit - 1 < GATE_BLOCK_BITS;
+}
 
-        // リピート実行ループ
-        for (int i=0; i<repeatNumber; ++i){
-            // 新しい回路行列の各行を処理（最大21行）
-            for (int w=0; w<21; ++w) {
-                // 空の行をスキップ
-                if (std::all_of(newCircuit+numQubits*w, newCircuit+numQubits*(w+1),[](int value) { return value == 0; })){
-                    continue;
+/**
+ * @brief ブロック単位でまとめて適用するゲート列を量子状態に適用し、列を空にする
+ *
+ * 1ゲートのみの場合は通常のスイープで適用します。
+ *
+ * @param state 量子状態ベクトル
+ * @param run 適用するゲート列（ターゲットはすべてブロック内）
+ * @param numQubits 量子ビット数
+ */
+template <typename Real>
+void applyGateRun(Real* state, vector<FusedGate>& run, int numQubits){
+    if (run.size() == 1){
+        const FusedGate& gate = run[0];
+        calculateState(state, gate.pack, gate.kind, gate.controlOnes, gate.controlZeros, numQubits, gate.targetQubit);
+    }else if (!run.empty()){
+        countPhase(COUNTER_SWEEPS, 1); // ブロック単位の1回の走査で全ゲートを適用
+        for (const FusedGate& gate : run){
+            countPhase(COUNTER_PAIRS, ldexp(1.0, numQubits - 1 - __builtin_popcount(gate.controlOnes | gate.controlZeros)));
+        }
+        parallelFor(1 << (numQubits - GATE_BLOCK_BITS), [&](int, int begin, int end){
+            for (int block = begin; block < end; ++block){
+                for (const FusedGate& gate : run){
+                    applyFusedGateToTile(state, gate, numQubits, static_cast<unsigned int>(block) << GATE_BLOCK_BITS, GATE_BLOCK_BITS);
                 }
+            }
+        }, 1);
+    }
+    run.clear();
+}
+
+/**
+ * @brief ブロック外ターゲットのゲートのために、入れ替え先とするブロック内の位置を選ぶ
+ *
+ * 先読み範囲でターゲットとして使われる回数が最も少ない量子ビットの位置を選びます。
+ *
+ * @param queue 実行待ちのゲート列
+ * @param index 対象ゲートの位置
+ * @param logical 状態ベクトル上の位置 → 量子ビット番号
+ * @param numQubits 量子ビット数
+ * @return int 入れ替え先の位置（入れ替えない場合は -1）
+ */
+int chooseSwapPosition(const vector<FusedGate>& queue, int index, const int* logical, int numQubits){
+    int uses[32] = {0}; // 先読み範囲での量子ビットごとのターゲット使用回数
+    int end = min(static_cast<int>(queue.size()), index + SWAP_LOOKAHEAD);
+    for (int k = index; k < end; ++k){
+        ++uses[queue[k].targetQubit];
+    }
+    int best = numQubits - GATE_BLOCK_BITS;
+    for (int p = best + 1; p < numQubits; ++p){
+        if (uses[logical[p]] < uses[logical[best]]){
+            best = p;
+        }
+    }
+    return uses[queue[index].targetQubit] - uses[logical[best]] >= SWAP_MIN_GAIN ? best : -1;
+}
 
-                // ターゲットビット（実際のゲートが配置されたビット）を検索
-                int targetQubit = findTargetQubit(newCircuit, numQubits, w, ncgate);
+/**
+ * @brief 実行待ちのゲート列を量子状態に適用し、列を空にする
+ *
+ * 状態ベクトルがゲートブロックより大きい場合、ターゲットがブロック内に収まる連続ゲートは
+ * ブロックごとにまとめて適用します。ブロック外のターゲットが先読み範囲で繰り返し使われる
+ * 場合は、ブロック内の量子ビットと並びを入れ替えてから適用し、最後に元の並びに戻します。
+ *
+ * @param state 量子状態ベクトル
+ * @param queue 実行待ちのゲート列
+ * @param numQubits 量子ビット数
+ */
+template <typename Real>
+void flushFusedGates(Real* state, vector<FusedGate>& queue, int numQubits){
+    PhaseTimer timer(COUNTER_GATE_MS);
+    if (numQubits <= GATE_BLOCK_BITS){
+        for (const FusedGate& gate : queue){
+            calculateState(state, gate.pack, gate.kind, gate.controlOnes, gate.controlZeros, numQubits, gate.targetQubit);
+        }
+        queue.clear();
+        return;
+    }
 
-                // ターゲットビットのゲートを特定してオフセットを取得
-                int gateOffset = calculateGateOffset(newCircuit, numQubits, w, gates, targetQubit);
+    int position[32]; // 量子ビット番号 → 状態ベクトル上の位置
+    int logical[32];  // 状態ベクトル上の位置 → 量子ビット番号
+    for (int q = 0; q < numQubits; ++q){
+        position[q] = logical[q] = q;
+    }
 
-                // 量子状態にゲート演算を適用
-                calculateState(state, ControlState, newCircuit, gatePacks, ncgate, gateOffset, numQubits, w, targetQubit);
+    vector<FusedGate> run; // ブロック単位でまとめて適用するゲート列
+    for (int i = 0; i < static_cast<int>(queue.size()); ++i){
+        const FusedGate& gate = queue[i];
+        if (!inGateBlock(position[gate.targetQubit], numQubits)){
+            int swapPosition = chooseSwapPosition(queue, i, logical, numQubits);
+            if (swapPosition >= 0){
+                applyGateRun(state, run, numQubits);
+                int from = position[gate.targetQubit];
+                swapQubits(state, numQubits, from, swapPosition);
+                swap(logical[from], logical[swapPosition]);
+                position[logical[from]] = from;
+                position[logical[swapPosition]] = swapPosition;
             }
-            (*progressShared)++; // プログレス更新（0~repeatNumber*(lows-1)）
+        }
+
+        // 状態ベクトル上の位置に変換
+        FusedGate mapped = gate;
+        mapped.targetQubit = position[gate.targetQubit];
+        mapped.controlOnes = mapQubitMask(gate.controlOnes, position);
+        mapped.controlZeros = mapQubitMask(gate.controlZeros, position);
+        if (inGateBlock(mapped.targetQubit, numQubits)){
+            run.push_back(mapped);
+        }else{
+            applyGateRun(state, run, numQubits);
+            calculateState(state, mapped.pack, mapped.kind, mapped.controlOnes, mapped.controlZeros, numQubits, mapped.targetQubit);
         }
     }
+    applyGateRun(state, run, numQubits);
 
-    // 実行完了チェック
-    if (maxProgress <= *progressShared){
-        *boolShared |= (1ULL << 7); // 完了フラグを設定    }
-    calculateTraceState(state, numQubits, densityMatrix); // 各量子ビットごとの密度行列計算
+    // 元の並びに戻す
+    for (int p = 0; p < numQubits; ++p){
+        while (logical[p] != p){
+            int q = logical[p];
+            swapQubits(state, numQubits, p, q);
+            swap(logical[p], logical[q]);
+        }
+    }
+    queue.clear();
 }
 
 /**
- * @brief WebAssemblyメインエントリーポイント関数
- * 
- * JavaScript側から呼び出される量子回路シミュレーションのメイン関数です。
- * 初期化、ゲート計算、状態演算、密度行列計算の全工程を管理します。
- * 
- * @param floatArray 各量子ビットの初期状態角度パラメータ [θ₀, φ₀, θ₁, φ₁, ...]
- * @param gateCircuitData 量子回路のゲート配置データ（numQubits × 回路長）
- * @param lengthintPointer 回路データ長のポインタ
- * @param numQubitsPointer 量子ビット数のポインタ
- * @param cutintPointer 実行制御パラメータのポインタ
- * @param resultShared 結果共有配列（未使用）
- * @param progressShared プログレス共有変数
- * @param boolShared 制御フラグ配列（ビットフィールド）
- * @param initialstate 量子状態ベクトル（2^numQubits × 2要素）
- * @param stateParams 状態パラメータ作業配列
- * @param ControlState 制御状態ビット配列
- * @param gatePacks ゲート行列要素配列（8要素×6ゲート）
- * @param gates ゲートID配列
- * @param newCircuit 新しい回路行列（21×21作業領域）
- * @param densityMatrix 密度行列結果配列（8要素×numQubits）
- * @param ncgate 特殊ゲートコード配列 [なし, 制御0, 制御1]
+ * @brief 実行待ちのゲート列をSoAレイアウトの量子状態に適用し、列を空にする
+ *
+ * SoAレイアウトではペア更新が連続区間の演算になるため、ブロック分割と並び替えは行わず
+ * ゲートごとに状態ベクトルを走査します。
  */
-extern "C" EMSCRIPTEN_KEEPALIVE void sumDoubleArray(
-    double* floatArray, 
-    int* gateCircuitData, 
-    int* lengthintPointer, 
-    int* numQubitsPointer, 
-    int* cutintPointer, 
-    double* resultShared, 
-    int* progressShared, 
-    uint64_t* boolShared, 
-    double* initialstate,
-    double* stateParams,
-    uint64_t* ControlState,
-    double* gatePacks,
-    int* gates,
-    int* newCircuit,
-    double* densityMatrix,
-    int* ncgate) {
+template <typename Real>
+void flushFusedGates(SplitState<Real> state, vector<FusedGate>& queue, int numQubits){
+    PhaseTimer timer(COUNTER_GATE_MS);
+    for (const FusedGate& gate : queue){
+        calculateState(state, gate.pack, gate.kind, gate.controlOnes, gate.controlZeros, numQubits, gate.targetQubit);
+    }
+    queue.clear();
+}
 
-    // JavaScript側からの入力パラメータを取得
-    int lengthint = *lengthintPointer;     // 回路データの総長さ
-    int numQubits = *numQubitsPointer;     // 量子ビット数
-    int cutint = *cutintPointer;           // 実行制御パラメータ
+/**
+ * @brief 通常実行時に状態ベクトルを保存する列（回路の行）間隔（0でチェックポイント無効）
+ */
+static int checkpointInterval = 4;
 
-    // 初期化フラグがセットされている場合
-    if(*boolShared & (1ULL << 1)){
-        // 回転角パラメータを計算
-        double theta = M_PI / (cutint == 0 ? 1 : cutint);
-        
-        // 各種ゲートの行列要素を事前計算
-        calculatGateState(theta, gatePacks, gates);
-        
-        // 量子状態を初期化
-        initialize(floatArray, numQubits, initialstate, stateParams);
-          // プログレス関連の初期化
-        *progressShared = 0;
-        *boolShared &= ~(1ULL << 7);  // 完了フラグをクリア
-        *boolShared &= ~(1ULL << 1);  // 初期化フラグをクリア
+/**
+ * @brief チェックポイントに使用する最大メモリ量（バイト）
+ *
+ * 状態ベクトル1つ分がこれを超える量子ビット数ではチェックポイントを作成しません。
+ */
+static size_t checkpointMaxBytes = static_cast<size_t>(16) << 20;
+
+/**
+ * @brief 途中の行まで実行した状態ベクトルの保存データ
+ */
+struct StateCheckpoint {
+    int row;                     // 保存時点までに実行した行数
+    vector<unsigned char> state; // 状態ベクトルのコピー
+};
+
+/**
+ * @brief チェックポイントと、それを作成したときの回路・初期状態
+ */
+struct CheckpointCache {
+    int numQubits = 0;                   // 量子ビット数
+    bool singlePrecision = false;        // 状態ベクトルの精度
+    bool splitLayout = false;            // 状態ベクトルのレイアウト（SoAかどうか）
+    vector<double> slider;               // 初期状態の角度パラメータ
+    vector<int> circuit;                 // 回路データ
+    vector<StateCheckpoint> checkpoints; // チェックポイント（行番号の昇順）
+    int interval = 0;                    // 保存間隔（メモリ上限で間引くと倍増）
+};
+
+static CheckpointCache checkpointCache; // 通常実行用のチェックポイント
+
+/**
+ * @brief チェックポイントの列間隔とメモリ上限を設定する（JavaScript側から呼び出し）
+ *
+ * @param interval 保存する列間隔（0で無効）
+ * @param maxMegabytes チェックポイントに使用する最大メモリ量（MB）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void setCheckpointInterval(int interval, int maxMegabytes){
+    checkpointInterval = max(0, interval);
+    checkpointMaxBytes = static_cast<size_t>(max(0, maxMegabytes)) << 20;
+    checkpointCache.checkpoints.clear();
+}
+
+/**
+ * @brief 回路・初期状態の変更点より前の最も近いチェックポイントから状態を復元する
+ *
+ * 初期状態（スライダー）・量子ビット数・精度・レイアウトが変わった場合は全て破棄します。
+ * 回路は行単位で比較し、最初に変更された行より後のチェックポイントを破棄します。
+ *
+ * @param state 量子状態ベクトル（復元先、Real* またはSplitState）
+ * @param floatArray 初期状態の角度パラメータ
+ * @param circuitData 回路データ
+ * @param lengthint 回路データ長
+ * @param numQubits 量子ビット数
+ * @param singlePrecision 単精度モードかどうか
+ * @return int 再開する行番号（0 = 最初から実行）
+ */
+template <typename State>
+int restoreCheckpoint(State state, double* floatArray, int* circuitData, int lengthint, int numQubits, bool singlePrecision){
+    CheckpointCache& cache = checkpointCache;
+    bool splitLayout = !is_pointer<State>::value;
+    bool sameSetting = cache.numQubits == numQubits &&
+        cache.singlePrecision == singlePrecision &&
+        cache.splitLayout == splitLayout &&
+        cache.slider.size() == static_cast<size_t>(2 * numQubits) &&
+        equal(cache.slider.begin(), cache.slider.end(), floatArray);
+
+    int resumeRow = 0;
+    if (!sameSetting){
+        cache.checkpoints.clear();
+    }else{
+        // 最初に変更された行を求める
+        int rows = min(static_cast<int>(cache.circuit.size()), lengthint) / numQubits;
+        int firstEdited = 0;
+        while (firstEdited < rows && equal(circuitData + firstEdited*numQubits, circuitData + (firstEdited+1)*numQubits,
+                                           cache.circuit.begin() + firstEdited*numQubits)){
+            ++firstEdited;
+        }
+
+        // 変更行より後のチェックポイントは無効
+        while (!cache.checkpoints.empty() && cache.checkpoints.back().row > firstEdited){
+            cache.checkpoints.pop_back();
+        }
+        if (!cache.checkpoints.empty()){
+            const StateCheckpoint& checkpoint = cache.checkpoints.back();
+            memcpy(stateData(state), checkpoint.state.data(), checkpoint.state.size());
+            resumeRow = checkpoint.row;
+        }
+    }
+
+    cache.numQubits = numQubits;
+    cache.singlePrecision = singlePrecision;
+    cache.splitLayout = splitLayout;
+    cache.slider.assign(floatArray, floatArray + 2 * numQubits);
+    cache.circuit.assign(circuitData, circuitData + lengthint);
+    if (cache.checkpoints.empty()){
+        cache.interval = checkpointInterval;
     }
+    return resumeRow;
+}
+
+/**
+ * @brief 保存間隔の行であれば、実行待ちのゲートを適用してから状態ベクトルを保存する
+ *
+ * メモリ上限を超える場合はチェックポイントを1つおきに間引き、保存間隔を倍にします。
+ *
+ * @param state 量子状態ベクトル（Real* またはSplitState、どちらも連続した 2^(numQubits+1) 要素）
+ * @param numQubits 量子ビット数
+ * @param row 実行済みの行数
+ */
+template <typename State>
+void saveCheckpoint(State state, int numQubits, int row){
+    CheckpointCache& cache = checkpointCache;
+    size_t bytes = sizeof(*stateData(state)) * 2 * (static_cast<size_t>(1) << numQubits);
+    if (cache.interval == 0 || row % cache.interval != 0 || bytes > checkpointMaxBytes){
+        return;
+    }
+    if (!cache.checkpoints.empty() && cache.checkpoints.back().row >= row){
+        return; // 再開位置より前のチェックポイントは保存済み
+    }
+
+    // メモリ上限を超える場合は間引く
+    while ((cache.checkpoints.size() + 1) * bytes > checkpointMaxBytes){
+        int interval = cache.interval * 2;
+        cache.checkpoints.erase(remove_if(cache.checkpoints.begin(), cache.checkpoints.end(),
+            [interval](const StateCheckpoint& checkpoint){ return checkpoint.row % interval != 0; }),
+            cache.checkpoints.end());
+        cache.interval = interval;
+        if (row % interval != 0){
+            return;
+        }
+    }
+
+    flushFusedGates(state, fusionQueue, numQubits); // 保存前に実行待ちのゲートを適用
+    StateCheckpoint checkpoint;
+    checkpoint.row = row;
+    checkpoint.state.resize(bytes);
+    memcpy(checkpoint.state.data(), stateData(state), bytes);
+    cache.checkpoints.push_back(move(checkpoint));
+}
 
-    // 量子状態演算のメイン実行
-    calculateMainState(
-        initialstate, 
-        numQubits, 
-        gates, 
-        gatePacks, 
-        gateCircuitData, 
-        cutint, 
-        resultShared, 
-        progressShared, 
-        boolShared, 
-        floatArray, 
-        lengthint,
-        stateParams,
-        ControlState,
-        newCircuit,
-        densityMatrix,
-        ncgate);
+/**
+ * @brief クラスタモードで1つのクラスタに含める最大の量子ビット数
+ *
+ * これを超える結合が必要になった時点で、全体の状態ベクトルに展開して通常の計算に切り替えます。
+ */
+const int CLUSTER_MAX_QUBITS = 14;
+
+/**
+ * @brief クラスタモードの計算終了時に全体の状態ベクトルも書き出す量子ビット数の上限
+ *
+ * 確率チャート（8量子ビット以下で表示）は状態ベクトル領域を直接読むため、
+ * この量子ビット数以下では書き出します。
+ */
+const int CLUSTER_EXPORT_MAX_QUBITS = 8;
+
+/**
+ * @brief 互いにエンタングルした可能性のある量子ビットの組と、その結合状態
+ *
+ * 局所番号kの量子ビットは amplitudes のビット位置 (qubits.size()-k-1) に対応します
+ * （全体の状態ベクトルと同じく局所番号0が最上位ビット）。
+ */
+struct QubitCluster {
+    vector<int> qubits;                 // 局所番号 → 量子ビット番号
+    vector<complex<double>> amplitudes; // 結合状態（2^qubits.size() 要素）
+};
+
+/**
+ * @brief クラスタモード（boolShared ビット6）の量子レジスタ
+ *
+ * 初期状態は各量子ビットが独立した2要素ベクトルで、複数の量子ビットにまたがる
+ * 制御ゲートが来たときだけ関係するクラスタをテンソル積で結合します。
+ * プログレッシブ実行に備えて呼び出し間で保持し、初期化フラグで作り直します。
+ */
+struct ClusterRegister {
+    vector<QubitCluster> clusters; // クラスタ一覧
+    int clusterOf[32];             // 量子ビット番号 → クラスタ番号
+    int localOf[32];               // 量子ビット番号 → クラスタ内の局所番号
+    bool promoted = false;         // 全体の状態ベクトルに展開済みかどうか
+};
+
+static ClusterRegister clusterRegister; // クラスタモードの量子レジスタ
+
+/**
+ * @brief 量子ビット番号とクラスタの対応表を作り直す
+ */
+inline void indexClusters(ClusterRegister& reg){
+    for (int c = 0; c < static_cast<int>(reg.clusters.size()); ++c){
+        const vector<int>& qubits = reg.clusters[c].qubits;
+        for (int k = 0; k < static_cast<int>(qubits.size()); ++k){
+            reg.clusterOf[qubits[k]] = c;
+            reg.localOf[qubits[k]] = k;
+        }
+    }
+}
+
+/**
+ * @brief 各量子ビットを独立したクラスタとして初期化する（O(numQubits)）
+ *
+ * @param reg クラスタレジスタ
+ * @param floatArray 各量子ビットの初期状態角度パラメータ [θ₀, φ₀, θ₁, φ₁, ...]
+ * @param numQubits 量子ビット数
+ * @param stateParams 状態パラメータ作業配列
+ */
+void initializeClusters(ClusterRegister& reg, double* floatArray, int numQubits, double* stateParams){
+    reg.clusters.assign(numQubits, QubitCluster());
+    for (int q = 0; q < numQubits; ++q){
+        calculateQubitState(floatArray[2 * q], floatArray[2 * q + 1], stateParams);
+        reg.clusters[q].qubits = {q};
+        reg.clusters[q].amplitudes = {complex<double>(stateParams[0], stateParams[1]),
+                                      complex<double>(stateParams[2], stateParams[3])};
+    }
+    reg.promoted = false;
+    indexClusters(reg);
+}
+
+/**
+ * @brief マスクの量子ビットを含むクラスタを1つに結合する
+ *
+ * 結合後の量子ビット数が CLUSTER_MAX_QUBITS を超える場合は結合しません。
+ *
+ * @param reg クラスタレジスタ
+ * @param qubitMask 結合する量子ビットのマスク（ビットq = 量子ビットq）
+ * @return int 結合したクラスタ番号（上限超過の場合は-1）
+ */
+int mergeClusters(ClusterRegister& reg, uint32_t qubitMask){
+    vector<int> members; // 結合するクラスタ番号（昇順）
+    int qubits = 0;
+    for (uint32_t mask = qubitMask; mask != 0; mask &= mask - 1){
+        int c = reg.clusterOf[__builtin_ctz(mask)];
+        if (find(members.begin(), members.end(), c) == members.end()){
+            members.push_back(c);
+            qubits += static_cast<int>(reg.clusters[c].qubits.size());
+        }
+    }
+    sort(members.begin(), members.end());
+    if (members.size() == 1){
+        return members[0];
+    }
+    if (qubits > CLUSTER_MAX_QUBITS){
+        return -1;
+    }
+
+    // テンソル積で結合（先頭のクラスタが上位ビット）
+    QubitCluster& merged = reg.clusters[members[0]];
+    for (size_t m = 1; m < members.size(); ++m){
+        const QubitCluster& other = reg.clusters[members[m]];
+        vector<complex<double>> amplitudes(merged.amplitudes.size() * other.amplitudes.size());
+        size_t low = other.amplitudes.size();
+        for (size_t i = 0; i < merged.amplitudes.size(); ++i){
+            for (size_t j = 0; j < low; ++j){
+                amplitudes[i * low + j] = merged.amplitudes[i] * other.amplitudes[j];
+            }
+        }
+        merged.amplitudes.swap(amplitudes);
+        merged.qubits.insert(merged.qubits.end(), other.qubits.begin(), other.qubits.end());
+    }
+    for (size_t m = members.size() - 1; m >= 1; --m){
+        reg.clusters.erase(reg.clusters.begin() + members[m]);
+    }
+    indexClusters(reg);
+    return members[0];
+}
+
+/**
+ * @brief クラスタの結合状態にゲートを適用する
+ */
+void applyClusterGate(ClusterRegister& reg, int cluster, const FusedGate& gate){
+    PhaseTimer timer(COUNTER_GATE_MS);
+    QubitCluster& target = reg.clusters[cluster];
+    uint32_t controlOnes = 0, controlZeros = 0;
+    for (uint32_t mask = gate.controlOnes; mask != 0; mask &= mask - 1){
+        controlOnes |= 1u << reg.localOf[__builtin_ctz(mask)];
+    }
+    for (uint32_t mask = gate.controlZeros; mask != 0; mask &= mask - 1){
+        controlZeros |= 1u << reg.localOf[__builtin_ctz(mask)];
+    }
+    calculateState(reinterpret_cast<double*>(target.amplitudes.data()), gate.pack, gate.kind,
+                   controlOnes, controlZeros, static_cast<int>(target.qubits.size()), reg.localOf[gate.targetQubit]);
+}
+
+/**
+ * @brief 状態ベクトルの振幅を1つ書き込む（レイアウト別）
+ */
+template <typename Real>
+inline void storeAmplitude(Real* state, size_t index, complex<double> amplitude){
+    state[2 * index] = static_cast<Real>(amplitude.real());
+    state[2 * index + 1] = static_cast<Real>(amplitude.imag());
+}
+
+template <typename Real>
+inline void storeAmplitude(SplitState<Real> state, size_t index, complex<double> amplitude){
+    state.re[index] = static_cast<Real>(amplitude.real());
+    state.im[index] = static_cast<Real>(amplitude.imag());
+}
+
+/**
+ * @brief 振幅を1つ読み出す（レイアウト別）
+ */
+template <typename Real>
+inline complex<double> loadAmplitude(const Real* state, size_t index){
+    return complex<double>(state[2 * index], state[2 * index + 1]);
+}
+
+template <typename Real>
+inline complex<double> loadAmplitude(SplitState<Real> state, size_t index){
+    return complex<double>(state.re[index], state.im[index]);
+}
+
+/**
+ * @brief 全クラスタのテンソル積を全体の状態ベクトルに書き出す
+ *
+ * @param reg クラスタレジスタ
+ * @param state 量子状態ベクトル（書き込み先）
+ * @param numQubits 量子ビット数
+ */
+template <typename State>
+void exportClusters(const ClusterRegister& reg, State state, int numQubits){
+    parallelFor(1 << numQubits, [&](int, int begin, int end){
+        for (int i = begin; i < end; ++i){
+            complex<double> amplitude = 1.0;
+            for (const QubitCluster& cluster : reg.clusters){
+                size_t local = 0;
+                for (int q : cluster.qubits){
+                    local = (local << 1) | ((i >> (numQubits - q - 1)) & 1);
+                }
+                amplitude *= cluster.amplitudes[local];
+            }
+            storeAmplitude(state, i, amplitude);
+        }
+    });
+}
+
+/**
+ * @brief クラスタの結合状態から各量子ビットの密度行列を計算する
+ *
+ * 密度行列の格納形式は calculateTraceState と同じです。
+ *
+ * @param reg クラスタレジスタ
+ * @param densityMatrix 密度行列結果配列（8要素×numQubits）
+ */
+void calculateClusterTrace(ClusterRegister& reg, double* densityMatrix){
+    vector<double> local;
+    for (QubitCluster& cluster : reg.clusters){
+        int size = static_cast<int>(cluster.qubits.size());
+        local.assign(8 * size, 0.0);
+        calculateTraceState(reinterpret_cast<double*>(cluster.amplitudes.data()), size, local.data());
+        for (int k = 0; k < size; ++k){
+            copy(local.begin() + 8 * k, local.begin() + 8 * k + 8, densityMatrix + 8 * cluster.qubits[k]);
+        }
+    }
+}
+
+/**
+ * @brief クラスタモードでゲートを適用する
+ *
+ * 関係するクラスタを結合してゲートを適用します。結合が CLUSTER_MAX_QUBITS を超える場合は
+ * 全体の状態ベクトルに展開し、以降は通常の実行待ち列で計算します。
+ *
+ * @param reg クラスタレジスタ
+ * @param gate 適用するゲート
+ * @param state 量子状態ベクトル（展開先）
+ * @param numQubits 量子ビット数
+ */
+template <typename State>
+void pushClusterGate(ClusterRegister& reg, const FusedGate& gate, State state, int numQubits){
+    if (!reg.promoted){
+        int cluster = mergeClusters(reg, gate.controlOnes | gate.controlZeros | (1u << gate.targetQubit));
+        if (cluster >= 0){
+            applyClusterGate(reg, cluster, gate);
+            return;
+        }
+        exportClusters(reg, state, numQubits);
+        reg.clusters.clear();
+        reg.promoted = true;
+    }
+    pushFusedGate(fusionQueue, gate);
+}
+
+/**
+ * @brief 疎表現を使う非ゼロ振幅数の上限（2^numQubits >> SPARSE_DENSITY_SHIFT）
+ *
+ * 既定のスライダー（|0...0⟩）と浅い回路では非ゼロの振幅がごく一部のため、
+ * これ以下の間は基底番号 → 振幅のハッシュ表でゲートを適用し、超えた時点で
+ * 全体の状態ベクトルに展開して通常の計算に切り替えます。
+ */
+const int SPARSE_DENSITY_SHIFT = 6;
+
+/**
+ * @brief 疎表現で0とみなす振幅の |amp|²（打ち消し合った振幅の丸め誤差を取り除く）
+ */
+const double SPARSE_DROP_NORM = 1e-24;
+
+/**
+ * @brief 量子ビット番号のマスク（ビットq = 量子ビットq）を状態ベクトルのビット位置のマスクに変換する
+ */
+inline uint32_t qubitMaskToIndexMask(uint32_t mask, int numQubits){
+    uint32_t index = 0;
+    for (int q = 0; q < numQubits; ++q){
+        if (mask & (1u << q)){
+            index |= 1u << (numQubits - q - 1);
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief 疎表現の量子状態（非ゼロの振幅のみ保持）
+ */
+struct SparseRegister {
+    unordered_map<uint32_t, complex<double>> amplitudes; // 基底番号 → 振幅
+    unordered_map<uint32_t, complex<double>> scratch;    // ゲート適用時の作業用
+    bool active = false;                                 // 疎表現で計算中かどうか
+};
+
+static SparseRegister sparseRegister; // 通常実行・全リピート実行の疎表現
+
+/**
+ * @brief 疎表現で保持する非ゼロ振幅数の上限
+ */
+inline size_t sparseLimit(int numQubits){
+    return (static_cast<size_t>(1) << numQubits) >> SPARSE_DENSITY_SHIFT;
+}
+
+/**
+ * @brief 初期状態を疎表現で作成する
+ *
+ * 各量子ビットの |0⟩ / |1⟩ 成分のうち0でないものの積で非ゼロの基底が決まります。
+ * 非ゼロ振幅数が sparseLimit を超える場合は作成しません（呼び出し元が initialize で初期化）。
+ *
+ * @param reg 疎表現の量子状態（出力）
+ * @param floatArray 初期状態パラメータ配列 [θ₀, φ₀, θ₁, φ₁, ...]（度単位）
+ * @param numQubits 量子ビット数
+ * @param stateParams 作業用状態パラメータ配列
+ * @return 疎表現で初期化した場合 true
+ */
+bool initializeSparse(SparseRegister& reg, double* floatArray, int numQubits, double* stateParams){
+    reg.active = false;
+    size_t count = 1;
+    for (int q = 0; q < numQubits; ++q){
+        calculateQubitState(floatArray[2*q], floatArray[2*q+1], stateParams);
+        bool zero = stateParams[0]*stateParams[0] + stateParams[1]*stateParams[1] >= SPARSE_DROP_NORM;
+        bool one = stateParams[2]*stateParams[2] + stateParams[3]*stateParams[3] >= SPARSE_DROP_NORM;
+        count *= (zero && one) ? 2 : 1;
+        if (count > sparseLimit(numQubits)){
+            return false;
+        }
+    }
+
+    // 量子ビット0（最上位ビット）から順にテンソル積を構築
+    reg.amplitudes.clear();
+    reg.amplitudes[0] = 1.0;
+    for (int q = 0; q < numQubits; ++q){
+        calculateQubitState(floatArray[2*q], floatArray[2*q+1], stateParams);
+        complex<double> alpha(stateParams[0], stateParams[1]);
+        complex<double> beta(stateParams[2], stateParams[3]);
+        uint32_t bit = 1u << (numQubits - q - 1);
+        reg.scratch.clear();
+        for (const auto& [index, amplitude] : reg.amplitudes){
+            if (norm(alpha) >= SPARSE_DROP_NORM){
+                reg.scratch[index] = amplitude * alpha;
+            }
+            if (norm(beta) >= SPARSE_DROP_NORM){
+                reg.scratch[index | bit] = amplitude * beta;
+            }
+        }
+        swap(reg.amplitudes, reg.scratch);
+    }
+    reg.active = true;
+    return true;
+}
+
+/**
+ * @brief 疎表現の量子状態にゲートを適用する
+ *
+ * 非ゼロの振幅ごとに、ターゲットビットが0・1の2つの基底への寄与を加算します。
+ * 計算量は非ゼロ振幅数に比例し、打ち消し合って0になった振幅は取り除きます。
+ */
+void applySparseGate(SparseRegister& reg, const FusedGate& gate, int numQubits){
+    PhaseTimer timer(COUNTER_GATE_MS);
+    uint32_t target = 1u << (numQubits - gate.targetQubit - 1);
+    uint32_t ones = qubitMaskToIndexMask(gate.controlOnes, numQubits);
+    uint32_t zeros = qubitMaskToIndexMask(gate.controlZeros, numQubits);
+    complex<double> m[4];
+    for (int e = 0; e < 4; ++e){
+        m[e] = complex<double>(gate.pack[2*e], gate.pack[2*e+1]);
+    }
+
+    reg.scratch.clear();
+    reg.scratch.reserve(2 * reg.amplitudes.size());
+    for (const auto& [index, amplitude] : reg.amplitudes){
+        if ((index & ones) != ones || (index & zeros)){
+            reg.scratch[index] += amplitude; // 制御条件を満たさない基底はそのまま
+            continue;
+        }
+        int b = (index & target) ? 1 : 0;
+        uint32_t base = index & ~target;
+        reg.scratch[base] += m[b] * amplitude;          // |0⟩側：m₀ᵦ
+        reg.scratch[base | target] += m[2 + b] * amplitude; // |1⟩側：m₁ᵦ
+    }
+    for (auto it = reg.scratch.begin(); it != reg.scratch.end(); ){
+        it = norm(it->second) < SPARSE_DROP_NORM ? reg.scratch.erase(it) : next(it);
+    }
+    swap(reg.amplitudes, reg.scratch);
+}
+
+/**
+ * @brief 疎表現の量子状態を全体の状態ベクトルに書き出す
+ */
+template <typename State>
+void exportSparseState(const SparseRegister& reg, State state, int numQubits){
+    parallelFor(1 << numQubits, [&](int, int begin, int end){
+        for (int i = begin; i < end; ++i){
+            storeAmplitude(state, i, 0.0);
+        }
+    });
+    for (const auto& [index, amplitude] : reg.amplitudes){
+        storeAmplitude(state, index, amplitude);
+    }
+}
+
+/**
+ * @brief 疎表現の量子状態から各量子ビットの密度行列を計算する
+ *
+ * 密度行列の格納形式は calculateTraceState と同じです。
+ * off-diagonal 要素は、ビットが0の振幅と対になる基底の振幅の積から求めます。
+ */
+void calculateSparseTrace(const SparseRegister& reg, int numQubits, double* densityMatrix){
+    double total = 0.0;
+    for (const auto& [index, amplitude] : reg.amplitudes){
+        total += norm(amplitude);
+    }
+    for (int q = 0; q < numQubits; ++q){
+        uint32_t bit = 1u << (numQubits - q - 1);
+        double one = 0.0;
+        complex<double> offDiagonal = 0.0;
+        for (const auto& [index, amplitude] : reg.amplitudes){
+            if (index & bit){
+                one += norm(amplitude);
+                continue;
+            }
+            auto partner = reg.amplitudes.find(index | bit);
+            if (partner != reg.amplitudes.end()){
+                offDiagonal += amplitude * conj(partner->second);
+            }
+        }
+        double* out = densityMatrix + 8*q;
+        out[0] = total - one;            // |0⟩確率
+        out[1] = 0.0;
+        out[2] = offDiagonal.real();     // ρ₀₁
+        out[3] = offDiagonal.imag();
+        out[4] = offDiagonal.real();     // ρ₁₀ = ρ₀₁*
+        out[5] = -offDiagonal.imag();
+        out[6] = 1 - out[0];             // |1⟩確率
+        out[7] = 0.0;
+    }
+}
+
+/**
+ * @brief 疎表現の間はゲートを直接適用し、それ以外は通常の実行待ち列に追加する
+ *
+ * 適用後の非ゼロ振幅数が sparseLimit を超えた場合は全体の状態ベクトルに展開し、
+ * 以降は通常の実行待ち列で計算します。
+ *
+ * @param reg 疎表現の量子状態
+ * @param gate 適用するゲート
+ * @param state 量子状態ベクトル（展開先）
+ * @param numQubits 量子ビット数
+ */
+template <typename State>
+void pushSparseGate(SparseRegister& reg, const FusedGate& gate, State state, int numQubits){
+    if (!reg.active){
+        pushFusedGate(fusionQueue, gate);
+        return;
+    }
+    applySparseGate(reg, gate, numQubits);
+    if (reg.amplitudes.size() > sparseLimit(numQubits)){
+        exportSparseState(reg, state, numQubits);
+        reg.active = false;
+    }
+}
+
+/**
+ * @brief 時間予算を確認する行の間隔（時計の読み出しを間引く）
+ */
+const int BUDGET_CHECK_ROWS = 4;
+
+/**
+ * @brief 時間予算のある実行で実行待ち列を途中で適用する作業量（待ちゲート数 × 2^numQubits）
+ *
+ * 実行待ちのゲートは経過時間に現れないため、この量を超えた場合のみ適用して時間を確認します。
+ * それ以下の間は行をまたいで融合・ブロック実行を続けます。
+ */
+const size_t BUDGET_FLUSH_WORK = static_cast<size_t>(1) << 24;
+
+/**
+ * @brief 量子状態演算のメイン実行関数
+ * 
+ * 量子回路全体を実行し、各ステップで状態を更新します。
+ * プログレッシブ実行、リピート実行、部分実行などの制御機能も提供します。
+ * 
+ * @param state 量子状態ベクトル（更新対象、Real* またはSplitState）
+ * @param numQubits 量子ビット数
+ * @param gatePacks ゲート行列要素配列
+ * @param gateKinds ゲート種類配列
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照）
+ * @param cutint 実行制御パラメータ（0=通常実行、>0=部分実行）
+ * @param progressShared プログレス共有変数
+ * @param boolShared 制御フラグ配列
+ * @param lengthint 回路データ長
+ * @param densityMatrix 密度行列結果配列
+ * @param timeBudget 1回の呼び出しの時間予算（ミリ秒、0で無制限）。
+ *                   通常実行と全リピート実行では、予算を超えた時点で行の区切りで中断し
+ *                   （boolShared ビット8）、次の呼び出しで progressShared の位置から再開します。
+ */
+template <typename State>
+void calculateMainState(
+    State state,
+    int numQubits,
+    double* gatePacks,
+    int* gateKinds,
+    const int* circuitOps,
+    int cutint,
+    int* progressShared,
+    uint64_t* boolShared,
+    int lengthint,
+    double* densityMatrix,
+    double timeBudget){
+
+    double startTime = emscripten_get_now(); // 時間予算の計測開始
+
+    // 実行制御パラメータの初期化
+    int lows = lengthint / numQubits;      // 回路の行数
+    int calculateLows = lows;              // 計算する行数
+    int repeatNumber = 1;                  // リピート回数
+    int nowRows = 0;                       // 現在の行番号
+    int maxProgress = (cutint == 0 ? 1 : cutint) * lows; // 最大プログレス値
+    
+    // プログレッシブ実行とリピート制御の設定
+    if (cutint != 0 && *boolShared & (1ULL << 2)){
+        if (*boolShared & (1ULL << 3)){
+            repeatNumber = cutint;         // 全リピートを実行
+        }else{
+            calculateLows = 1;             // 1行ずつ実行
+            nowRows = *progressShared / cutint;
+        }
+    }
+
+    // 通常実行・全リピート実行では progressShared の位置から再開
+    // （チェックポイントから復元した行、または時間予算で中断した位置）
+    bool resumable = cutint == 0 || (*boolShared & (1ULL << 2) && *boolShared & (1ULL << 3));
+    int firstRow = resumable ? *progressShared / repeatNumber : 0;
+    int firstRepeat = resumable ? *progressShared % repeatNumber : 0;
+
+    // クラスタモード（ビット6）ではゲートをクラスタ単位で適用
+    bool clusterMode = (*boolShared & (1ULL << 6)) != 0;
+    int rowsSinceCheck = 0; // 前回の時間予算の確認からの行数
+
+    // 演算リストの各行の先頭位置と演算列
+    const int* rowStart = circuitOps + 1;
+    const int* ops = circuitOps + 2 + circuitOps[0];
+
+    {
+        // 演算リストの処理時間（途中のゲート適用は COUNTER_GATE_MS に計上）
+        PhaseTimer circuitTimer(COUNTER_CIRCUIT_MS, COUNTER_GATE_MS);
+
+        // メイン実行ループ：回路の各行を処理
+        for(int a=firstRow; a<calculateLows; ++a){
+            int row = nowRows == 0 ? a : nowRows; // 実行する回路の行
+
+            // リピート実行ループ
+            for (int i = (a == firstRow ? firstRepeat : 0); i<repeatNumber; ++i){
+                // 行内の各演算を実行待ち列に追加（同一ターゲット・同一制御の連続ゲートは融合）
+                for (int k = rowStart[row]; k < rowStart[row+1]; ++k) {
+                    const int* op = ops + CIRCUIT_OP_SIZE * k;
+                    FusedGate gate;
+                    gate.targetQubit = op[0];
+                    gate.controlOnes = static_cast<uint32_t>(op[2]);
+                    gate.controlZeros = static_cast<uint32_t>(op[3]);
+                    copy(gatePacks + 8*op[1], gatePacks + 8*op[1] + 8, gate.pack);
+                    gate.kind = gateKinds[op[1]];
+                    if (clusterMode){
+                        pushClusterGate(clusterRegister, gate, state, numQubits);
+                    }else{
+                        pushSparseGate(sparseRegister, gate, state, numQubits);
+                    }
+                }
+                (*progressShared)++; // プログレス更新（0~repeatNumber*(lows-1)）
+
+                // 通常実行では一定の列間隔で状態ベクトルを保存（クラスタモード・疎表現では保存しない）
+                if (cutint == 0 && !clusterMode && !sparseRegister.active && *progressShared < lows){
+                    saveCheckpoint(state, numQubits, *progressShared);
+                }
+
+                // 時間予算を超えたら、実行待ちのゲートを適用してから中断（密度行列は完了時に計算）
+                // 時間の確認は BUDGET_CHECK_ROWS 行ごと、または実行待ち列が BUDGET_FLUSH_WORK に達した時点
+                if (timeBudget > 0 && resumable && *progressShared < maxProgress){
+                    bool queueFull = (fusionQueue.size() << numQubits) >= BUDGET_FLUSH_WORK;
+                    if (queueFull){
+                        flushFusedGates(state, fusionQueue, numQubits);
+                    }
+                    if (queueFull || ++rowsSinceCheck >= BUDGET_CHECK_ROWS){
+                        rowsSinceCheck = 0;
+                        if (emscripten_get_now() - startTime >= timeBudget){
+                            flushFusedGates(state, fusionQueue, numQubits);
+                            if (sparseRegister.active){
+                                // 次の呼び出しは状態ベクトルから再開
+                                exportSparseState(sparseRegister, state, numQubits);
+                                sparseRegister.active = false;
+                            }
+                            *boolShared |= (1ULL << 8); // 中断フラグを設定
+                            return;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // 実行完了チェック
+    if (maxProgress <= *progressShared){
+        *boolShared |= (1ULL << 7); // 完了フラグを設定
+    }
+
+    // 展開前のクラスタモードでは、クラスタごとに密度行列を計算
+    if (clusterMode && !clusterRegister.promoted){
+        PhaseTimer traceTimer(COUNTER_TRACE_MS);
+        calculateClusterTrace(clusterRegister, densityMatrix);
+        if (numQubits <= CLUSTER_EXPORT_MAX_QUBITS){
+            exportClusters(clusterRegister, state, numQubits);
+        }
+        return;
+    }
+
+    // 疎表現のまま完了した場合は、非ゼロの振幅から密度行列を計算して状態ベクトルに書き出す
+    if (sparseRegister.active){
+        PhaseTimer traceTimer(COUNTER_TRACE_MS);
+        calculateSparseTrace(sparseRegister, numQubits, densityMatrix);
+        exportSparseState(sparseRegister, state, numQubits);
+        sparseRegister.active = false;
+        return;
+    }
+
+    if constexpr (is_pointer<State>::value){
+        // 最後のゲートがタイル内で完結する場合は密度行列計算のタイル処理で適用する
+        bool fuseLast = !fusionQueue.empty() && fitsTraceTile(fusionQueue.back(), numQubits);
+        FusedGate lastGate;
+        if (fuseLast){
+            lastGate = fusionQueue.back();
+            fusionQueue.pop_back();
+        }
+
+        // 融合済みのゲート列を量子状態に適用
+        flushFusedGates(state, fusionQueue, numQubits);
+
+        // 各量子ビットごとの密度行列計算
+        PhaseTimer traceTimer(COUNTER_TRACE_MS);
+        if (fuseLast){
+            calculateTraceState(state, numQubits, densityMatrix, [&](unsigned int base, int tileBits){
+                applyFusedGateToTile(state, lastGate, numQubits, base, tileBits);
+            });
+        }else{
+            calculateTraceState(state, numQubits, densityMatrix);
+        }
+    }else{
+        // SoAレイアウト：ゲート列を適用してから密度行列を計算
+        flushFusedGates(state, fusionQueue, numQubits);
+        PhaseTimer traceTimer(COUNTER_TRACE_MS);
+        calculateTraceState(state, numQubits, densityMatrix);
+    }
+}
+
+/**
+ * @brief スタビライザー形式で扱える1量子ビットゲート（位相を除いたクリフォード行列）
+ */
+enum CliffordGate {
+    CLIFFORD_NONE = -1, // クリフォードゲートではない（任意角の回転・Tゲートなど）
+    CLIFFORD_I = 0,
+    CLIFFORD_X,
+    CLIFFORD_Y,
+    CLIFFORD_Z,
+    CLIFFORD_H,
+    CLIFFORD_S,
+    CLIFFORD_SDG        // S†
+};
+
+/**
+ * @brief ゲート行列を i^k × (クリフォード行列) に分類する
+ *
+ * gatePacks は θ に応じて値が変わるため、ゲート番号ではなく行列そのものを比較します
+ * （通常実行の θ = π では X, Y, Z, S, H が該当し、T や部分実行の回転は該当しません）。
+ *
+ * @param pack ゲート行列（gatePacksと同じ並び）
+ * @param phaseQuarter 出力：行列に掛かる位相 i^k の k（0~3）
+ * @return CliffordGate（該当しない場合は CLIFFORD_NONE）
+ */
+int classifyCliffordPack(const double* pack, int* phaseQuarter){
+    const double r = 1.0 / sqrt(2.0);
+    const complex<double> I(0.0, 1.0);
+    const complex<double> candidates[7][4] = {
+        {1, 0, 0, 1},   // I
+        {0, 1, 1, 0},   // X
+        {0, -I, I, 0},  // Y
+        {1, 0, 0, -1},  // Z
+        {r, r, r, -r},  // H
+        {1, 0, 0, I},   // S
+        {1, 0, 0, -I}   // S†
+    };
+    const complex<double> phases[4] = {1.0, I, -1.0, -I};
+    for (int gate = 0; gate < 7; ++gate){
+        for (int k = 0; k < 4; ++k){
+            bool match = true;
+            for (int e = 0; e < 4 && match; ++e){
+                match = abs(complex<double>(pack[2*e], pack[2*e+1]) - phases[k] * candidates[gate][e]) < 1e-9;
+            }
+            if (match){
+                *phaseQuarter = k;
+                return gate;
+            }
+        }
+    }
+    return CLIFFORD_NONE;
+}
+
+/**
+ * @brief スタビライザー状態のタブロー（Aaronson–Gottesman形式）
+ *
+ * 行0~n-1が destabilizer、行n~2n-1が stabilizer 生成元で、各行はパウリ演算子
+ * (-1)^r · ⊗ P_q（(x, z) = (1, 0) が X、(1, 1) が Y、(0, 1) が Z）を表します。
+ * x, z のビットq = 量子ビットq で、演算リストのマスクと同じ並びです。
+ */
+struct StabilizerTableau {
+    int numQubits = 0;
+    vector<uint32_t> x;
+    vector<uint32_t> z;
+    vector<uint8_t> r;
+};
+
+/**
+ * @brief |00...0⟩ のタブローを作成する（destabilizer = X_q、stabilizer = Z_q）
+ */
+void resetTableau(StabilizerTableau& t, int numQubits){
+    t.numQubits = numQubits;
+    t.x.assign(2 * numQubits, 0);
+    t.z.assign(2 * numQubits, 0);
+    t.r.assign(2 * numQubits, 0);
+    for (int q = 0; q < numQubits; ++q){
+        t.x[q] = 1u << q;
+        t.z[numQubits + q] = 1u << q;
+    }
+}
+
+void tableauH(StabilizerTableau& t, int q){
+    for (size_t i = 0; i < t.r.size(); ++i){
+        uint32_t xq = (t.x[i] >> q) & 1, zq = (t.z[i] >> q) & 1;
+        t.r[i] ^= xq & zq;
+        t.x[i] = (t.x[i] & ~(1u << q)) | (zq << q);
+        t.z[i] = (t.z[i] & ~(1u << q)) | (xq << q);
+    }
+}
+
+void tableauS(StabilizerTableau& t, int q){
+    for (size_t i = 0; i < t.r.size(); ++i){
+        uint32_t xq = (t.x[i] >> q) & 1, zq = (t.z[i] >> q) & 1;
+        t.r[i] ^= xq & zq;
+        t.z[i] ^= xq << q;
+    }
+}
+
+/**
+ * @brief パウリゲート X^x Z^z（x = z = 1 は Y）を適用する（位相の符号のみ変わる）
+ */
+void tableauPauli(StabilizerTableau& t, int q, uint32_t px, uint32_t pz){
+    for (size_t i = 0; i < t.r.size(); ++i){
+        t.r[i] ^= ((t.z[i] >> q) & px & 1) ^ ((t.x[i] >> q) & pz & 1);
+    }
+}
+
+void tableauCNOT(StabilizerTableau& t, int control, int target){
+    for (size_t i = 0; i < t.r.size(); ++i){
+        uint32_t xc = (t.x[i] >> control) & 1, zc = (t.z[i] >> control) & 1;
+        uint32_t xt = (t.x[i] >> target) & 1, zt = (t.z[i] >> target) & 1;
+        t.r[i] ^= xc & zt & (xt ^ zc ^ 1);
+        t.x[i] ^= xc << target;
+        t.z[i] ^= zt << control;
+    }
+}
+
+/**
+ * @brief 行 h に行 (ix, iz, ir) を掛ける（h ← i-行 × h、位相は i の指数の和から求める）
+ */
+void tableauRowsum(uint32_t& hx, uint32_t& hz, uint8_t& hr, uint32_t ix, uint32_t iz, uint8_t ir, int numQubits){
+    int exponent = 2 * hr + 2 * ir;
+    for (int q = 0; q < numQubits; ++q){
+        int x1 = (ix >> q) & 1, z1 = (iz >> q) & 1;
+        int x2 = (hx >> q) & 1, z2 = (hz >> q) & 1;
+        if (x1 && z1){
+            exponent += z2 - x2;
+        }else if (x1){
+            exponent += z2 * (2 * x2 - 1);
+        }else if (z1){
+            exponent += x2 * (1 - 2 * z2);
+        }
+    }
+    hr = ((exponent % 4) + 4) % 4 == 0 ? 0 : 1;
+    hx ^= ix;
+    hz ^= iz;
+}
+
+/**
+ * @brief パウリ演算子 X^px Z^pz の期待値（スタビライザー状態では +1 / -1 / 0）を求める
+ */
+int tableauExpectation(const StabilizerTableau& t, uint32_t px, uint32_t pz){
+    int n = t.numQubits;
+    auto anticommutes = [&](int row){
+        return __builtin_popcount((t.x[row] & pz) ^ (t.z[row] & px)) & 1;
+    };
+    for (int i = n; i < 2 * n; ++i){
+        if (anticommutes(i)){
+            return 0; // 生成元と反可換：測定結果は等確率
+        }
+    }
+    // 反可換な destabilizer に対応する stabilizer の積が ±P になる
+    uint32_t sx = 0, sz = 0;
+    uint8_t sr = 0;
+    for (int i = 0; i < n; ++i){
+        if (anticommutes(i)){
+            tableauRowsum(sx, sz, sr, t.x[n + i], t.z[n + i], t.r[n + i], n);
+        }
+    }
+    return sr ? -1 : 1;
+}
+
+/**
+ * @brief 量子ビット q を Z 基底で測定し、状態を測定後の状態に更新する（ランダムな場合は結果0を選ぶ）
+ *
+ * @return 測定結果（0 または 1）
+ */
+int tableauMeasure(StabilizerTableau& t, int q){
+    int n = t.numQubits;
+    uint32_t bit = 1u << q;
+    int p = -1;
+    for (int i = n; i < 2 * n && p < 0; ++i){
+        if (t.x[i] & bit){
+            p = i;
+        }
+    }
+    if (p < 0){
+        // 確定的な結果：destabilizer の x_q に対応する stabilizer の積の符号
+        uint32_t sx = 0, sz = 0;
+        uint8_t sr = 0;
+        for (int i = 0; i < n; ++i){
+            if (t.x[i] & bit){
+                tableauRowsum(sx, sz, sr, t.x[n + i], t.z[n + i], t.r[n + i], n);
+            }
+        }
+        return sr;
+    }
+    for (int i = 0; i < 2 * n; ++i){
+        if (i != p && (t.x[i] & bit)){
+            tableauRowsum(t.x[i], t.z[i], t.r[i], t.x[p], t.z[p], t.r[p], n);
+        }
+    }
+    t.x[p - n] = t.x[p];
+    t.z[p - n] = t.z[p];
+    t.r[p - n] = t.r[p];
+    t.x[p] = 0;
+    t.z[p] = bit;
+    t.r[p] = 0;
+    return 0;
+}
+
+/**
+ * @brief 1量子ビットのクリフォードゲート（位相を除く）をタブローに適用する
+ */
+void tableauGate(StabilizerTableau& t, int gate, int q){
+    switch (gate){
+        case CLIFFORD_X: tableauPauli(t, q, 1, 0); break;
+        case CLIFFORD_Y: tableauPauli(t, q, 1, 1); break;
+        case CLIFFORD_Z: tableauPauli(t, q, 0, 1); break;
+        case CLIFFORD_H: tableauH(t, q); break;
+        case CLIFFORD_S: tableauS(t, q); break;
+        case CLIFFORD_SDG: tableauS(t, q); tableauS(t, q); tableauS(t, q); break;
+        default: break;
+    }
+}
+
+/**
+ * @brief 初期状態と回路をタブローで実行する（スタビライザー回路でない場合は false）
+ *
+ * 初期状態は各量子ビットが |0⟩, |1⟩, |±⟩, |±i⟩ のいずれか（スライダーの θ = 0/180、
+ * または θ = 90 かつ φ = 0/90/180/270）の場合に限ります。
+ * ゲートは制御なしのクリフォードゲートと、制御ビット1つのパウリゲート（位相 i^k 付き、
+ * 制御側の S^k として適用）を扱い、それ以外（T・任意角・複数制御・制御付きH/S）を含む場合は
+ * false を返します。1ゲート当たりの計算量は O(numQubits) で、状態ベクトルを使いません。
+ *
+ * @param t タブロー（出力）
+ * @param floatArray 初期状態パラメータ配列 [θ₀, φ₀, θ₁, φ₁, ...]（度単位）
+ * @param numQubits 量子ビット数（32以下）
+ * @param gatePacks ゲート行列要素配列（calculatGateState の出力）
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照、全ての行を1回ずつ実行）
+ * @return タブローで実行できた場合 true
+ */
+bool runStabilizerCircuit(StabilizerTableau& t, const double* floatArray, int numQubits, const double* gatePacks, const int* circuitOps){
+    if (numQubits <= 0 || numQubits > 32){
+        return false;
+    }
+    resetTableau(t, numQubits);
+
+    // 初期状態：|0⟩ からの準備手順（|1⟩ = X, |±⟩ = H (Z), |±i⟩ = H S (Z)）
+    for (int q = 0; q < numQubits; ++q){
+        double stateParams[4];
+        calculateQubitState(floatArray[2*q], floatArray[2*q+1], stateParams);
+        complex<double> alpha(stateParams[0], stateParams[1]);
+        complex<double> beta(stateParams[2], stateParams[3]);
+        if (abs(beta) < 1e-9){
+            continue;
+        }
+        if (abs(alpha) < 1e-9){
+            tableauPauli(t, q, 1, 0);
+            continue;
+        }
+        complex<double> ratio = beta / alpha; // |α| = |β| の場合の相対位相
+        if (abs(abs(alpha) - abs(beta)) > 1e-9){
+            return false;
+        }
+        tableauH(t, q);
+        if (abs(ratio - complex<double>(0, 1)) < 1e-9 || abs(ratio - complex<double>(0, -1)) < 1e-9){
+            tableauS(t, q);
+            if (ratio.imag() < 0){
+                tableauPauli(t, q, 0, 1);
+            }
+        }else if (abs(ratio + 1.0) < 1e-9){
+            tableauPauli(t, q, 0, 1);
+        }else if (abs(ratio - 1.0) >= 1e-9){
+            return false;
+        }
+    }
+
+    const int* rowStart = circuitOps + 1;
+    const int* ops = circuitOps + 2 + circuitOps[0];
+    for (int k = 0; k < rowStart[circuitOps[0]]; ++k){
+        const int* op = ops + CIRCUIT_OP_SIZE * k;
+        int target = op[0];
+        uint32_t controlOnes = static_cast<uint32_t>(op[2]);
+        uint32_t controlZeros = static_cast<uint32_t>(op[3]);
+        int phaseQuarter = 0;
+        int gate = classifyCliffordPack(gatePacks + 8*op[1], &phaseQuarter);
+        int controls = __builtin_popcount(controlOnes | controlZeros);
+        if (gate == CLIFFORD_NONE || controls > 1 || (controls == 1 && gate > CLIFFORD_Z)){
+            return false;
+        }
+        if (controls == 0){
+            tableauGate(t, gate, target); // 全体の位相は無視できる
+            continue;
+        }
+
+        // 制御付き i^k·P = (制御ビットの S^k) × (制御付きP)、|0⟩条件は制御ビットを X で挟む
+        int control = __builtin_ctz(controlOnes | controlZeros);
+        if (controlZeros){
+            tableauPauli(t, control, 1, 0);
+        }
+        for (int s = 0; s < phaseQuarter; ++s){
+            tableauS(t, control);
+        }
+        if (gate == CLIFFORD_X){
+            tableauCNOT(t, control, target);
+        }else if (gate == CLIFFORD_Z){
+            tableauH(t, target);
+            tableauCNOT(t, control, target);
+            tableauH(t, target);
+        }else if (gate == CLIFFORD_Y){
+            tableauGate(t, CLIFFORD_SDG, target);
+            tableauCNOT(t, control, target);
+            tableauS(t, target);
+        }
+        if (controlZeros){
+            tableauPauli(t, control, 1, 0);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief タブローから各量子ビットの密度行列を求める（calculateTraceState と同じ格納形式）
+ *
+ * ρ = (I + ⟨X⟩X + ⟨Y⟩Y + ⟨Z⟩Z) / 2 で、各期待値は +1 / -1 / 0 です。
+ */
+void calculateStabilizerTrace(const StabilizerTableau& t, double* densityMatrix){
+    for (int q = 0; q < t.numQubits; ++q){
+        uint32_t bit = 1u << q;
+        double x = tableauExpectation(t, bit, 0);
+        double y = tableauExpectation(t, bit, bit);
+        double z = tableauExpectation(t, 0, bit);
+        double* out = densityMatrix + 8*q;
+        out[0] = (1 + z) / 2; // |0⟩確率
+        out[1] = 0.0;
+        out[2] = x / 2;       // ρ₀₁ = (⟨X⟩ - i⟨Y⟩) / 2
+        out[3] = -y / 2;
+        out[4] = x / 2;       // ρ₁₀ = ρ₀₁*
+        out[5] = y / 2;
+        out[6] = (1 - z) / 2; // |1⟩確率
+        out[7] = 0.0;
+    }
+}
+
+/**
+ * @brief スタビライザー状態を状態ベクトルに書き出す（全体の位相は任意）
+ *
+ * 測定で振幅が0でない基底 |b⟩ を見つけ、|ψ⟩ ∝ Π(I + S_i)/2 |b⟩ を生成元ごとの走査で求めます。
+ * 走査は numQubits 回（O(numQubits·2^numQubits)）のため、ゲート数が量子ビット数以下の回路では使いません。
+ * 確率チャート・測定サンプリング・量子ビット対の指標が状態ベクトル領域を読むために使います。
+ *
+ * @param t タブロー
+ * @param state 量子状態ベクトル（書き込み先、Real* またはSplitState）
+ */
+template <typename State>
+void exportStabilizerState(const StabilizerTableau& t, State state){
+    int n = t.numQubits;
+    auto toIndexMask = [n](uint32_t mask){ return qubitMaskToIndexMask(mask, n); };
+
+    StabilizerTableau measured = t;
+    uint32_t basis = 0;
+    for (int q = 0; q < n; ++q){
+        basis |= static_cast<uint32_t>(tableauMeasure(measured, q)) << q;
+    }
+
+    // 状態ベクトル領域で直接射影する（作業用の複素配列は確保しない）
+    parallelFor(1 << n, [&](int, int begin, int end){
+        for (int k = begin; k < end; ++k){
+            storeAmplitude(state, k, 0.0);
+        }
+    });
+    storeAmplitude(state, toIndexMask(basis), 1.0);
+    const complex<double> phases[4] = {1.0, complex<double>(0, 1), -1.0, complex<double>(0, -1)};
+    for (int i = n; i < 2 * n; ++i){
+        uint32_t xMask = toIndexMask(t.x[i]);
+        uint32_t zMask = toIndexMask(t.z[i]);
+        // S|k⟩ = (-1)^r · i^(Yの数) · (-1)^popcount(k & z) |k ⊕ x⟩
+        complex<double> sign = phases[(2 * t.r[i] + __builtin_popcount(t.x[i] & t.z[i])) % 4];
+        auto coefficient = [&](uint32_t k){
+            return (__builtin_popcount(k & zMask) & 1) ? -sign : sign;
+        };
+        parallelFor(1 << n, [&](int, int begin, int end){
+            for (int k = begin; k < end; ++k){
+                uint32_t partner = static_cast<uint32_t>(k) ^ xMask;
+                if (partner == static_cast<uint32_t>(k)){
+                    storeAmplitude(state, k, loadAmplitude(state, k) * (1.0 + coefficient(k)) / 2.0);
+                }else if (partner > static_cast<uint32_t>(k)){
+                    complex<double> a = loadAmplitude(state, k), b = loadAmplitude(state, partner);
+                    storeAmplitude(state, k, (a + coefficient(partner) * b) / 2.0);
+                    storeAmplitude(state, partner, (b + coefficient(k) * a) / 2.0);
+                }
+            }
+        });
+    }
+
+    double total = 0.0;
+    for (size_t k = 0; k < (static_cast<size_t>(1) << n); ++k){
+        total += norm(loadAmplitude(state, k));
+    }
+    double scale = 1.0 / sqrt(total);
+    parallelFor(1 << n, [&](int, int begin, int end){
+        for (int k = begin; k < end; ++k){
+            storeAmplitude(state, k, loadAmplitude(state, k) * scale);
+        }
+    });
+}
+
+static StabilizerTableau stabilizerTableau; // スタビライザー回路のタブロー
+
+/**
+ * @brief スタビライザー回路の各量子ビットの密度行列を状態ベクトルなしで計算する
+ *
+ * 32量子ビットまでのH/S/X/Y/Z/CNOTの回路を O(numQubits) / ゲートで実行するため、
+ * 状態ベクトルを確保できない量子ビット数でも使えます（runStabilizerCircuit の条件を満たす場合）。
+ *
+ * @param floatArray 初期状態パラメータ配列 [θ₀, φ₀, θ₁, φ₁, ...]（度単位）
+ * @param numQubits 量子ビット数
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照、全ての行を1回ずつ実行）
+ * @param densityMatrix 密度行列結果配列（8要素×numQubits）
+ * @return 計算できた場合1、スタビライザー回路でない場合0（densityMatrix は変更しない）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE int calculateStabilizerDensityMatrices(double* floatArray, int numQubits, const int* circuitOps, double* densityMatrix){
+    double gatePacks[48];
+    int gates[6];
+    int gateKinds[6];
+    calculatGateState(M_PI, gatePacks, gates, gateKinds);
+    if (!runStabilizerCircuit(stabilizerTableau, floatArray, numQubits, gatePacks, circuitOps)){
+        return 0;
+    }
+    calculateStabilizerTrace(stabilizerTableau, densityMatrix);
+    return 1;
+}
+
+/**
+ * @brief Workerとの制御ブロックの要素数（funcqcal.js / worker.js の CONTROL_LENGTH と共通）
+ */
+constexpr int WORKER_CONTROL_LENGTH = 2 + 16;
+
+alignas(16) static int32_t workerControl[WORKER_CONTROL_LENGTH]; // Workerとの制御ブロック
+
+/**
+ * @brief Workerとの制御ブロックの先頭を返す（JavaScript側から呼び出し）
+ *
+ * 静的領域に置くため、メモリを拡張してもアドレスは変わりません。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE int32_t* workerControlBlock(){
+    return workerControl;
+}
+
+/**
+ * @brief JavaScriptと共有する計算領域（アリーナ）
+ *
+ * sumDoubleArray の引数となる領域（状態ベクトル・回路データ等）を1つのブロックに並べます。
+ * 回路の量子ビット数に合わせて確保し直すため、少ない量子ビット数では最大量子ビット分を確保しません。
+ */
+struct SharedArena {
+    unsigned char* base = nullptr; // ブロックの先頭
+    size_t capacity = 0;           // 確保済みのバイト数
+};
+
+static SharedArena sharedArena; // sumDoubleArray 用のアリーナ
+
+constexpr size_t ARENA_ALIGNMENT = 16;                      // 各領域の境界（SIMDロードと同じ）
+constexpr size_t ARENA_GRANULE = static_cast<size_t>(64) << 10; // 確保単位（WebAssemblyの1ページ）
+
+/**
+ * @brief アリーナに領域を並べ、各領域の先頭アドレスを返す（JavaScript側から呼び出し）
+ *
+ * regions には各領域のバイト長を渡し、同じ配列に先頭アドレス（WebAssemblyメモリ上のオフセット）を書き戻します。
+ * 必要量が確保済みを超えた場合は確保し直し、必要量が確保済みの1/4以下になった場合は縮小して
+ * 残りをエンジンのヒープ（チェックポイント等）に返します。
+ * 確保し直した場合は領域の内容を引き継がないため、初期化フラグ付きの呼び出しの前に使用します。
+ * WebAssembly（32ビットアドレス）用で、確保できない場合は全要素を0にして0を返します。
+ *
+ * @param regions 領域のバイト長（入力）/ 先頭アドレス（出力）
+ * @param count 領域の数
+ * @return 成功した場合1
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE int32_t layoutArena(int32_t* regions, int count){
+    // 各領域の開始位置を境界に揃えて合計サイズを求める
+    size_t total = 0;
+    vector<size_t> starts(count);
+    for (int i = 0; i < count; ++i){
+        starts[i] = total;
+        total += (static_cast<size_t>(regions[i]) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    }
+    size_t required = max((total + ARENA_GRANULE - 1) & ~(ARENA_GRANULE - 1), ARENA_GRANULE);
+
+    // 不足する場合は拡張、大きく余る場合は縮小
+    SharedArena& arena = sharedArena;
+    if (required > arena.capacity || required * 4 <= arena.capacity){
+        free(arena.base);
+        arena.base = static_cast<unsigned char*>(aligned_alloc(ARENA_ALIGNMENT, required));
+        arena.capacity = arena.base ? required : 0;
+    }
+    if (!arena.base){
+        fill(regions, regions + count, 0);
+        return 0;
+    }
+
+    for (int i = 0; i < count; ++i){
+        regions[i] = static_cast<int32_t>(reinterpret_cast<uintptr_t>(arena.base + starts[i]));
+    }
+    return 1;
+}
+
+/**
+ * @brief WebAssemblyメインエントリーポイント関数
+ * 
+ * JavaScript側から呼び出される量子回路シミュレーションのメイン関数です。
+ * 初期化、ゲート計算、状態演算、密度行列計算の全工程を管理します。
+ * 
+ * @param floatArray 各量子ビットの初期状態角度パラメータ [θ₀, φ₀, θ₁, φ₁, ...]
+ * @param gateCircuitData 量子回路のゲート配置データ（numQubits × 回路長、チェックポイントの変更行検出に使用）
+ * @param lengthintPointer 回路データ長のポインタ
+ * @param numQubitsPointer 量子ビット数のポインタ
+ * @param cutintPointer 実行制御パラメータのポインタ
+ * @param resultShared 結果共有配列（未使用）
+ * @param progressShared プログレス共有変数
+ * @param boolShared 制御フラグ配列（ビットフィールド、ビット4 = 単精度モード、ビット5 = SoAレイアウト、
+ *                   ビット6 = クラスタモード、ビット8 = 時間予算による中断）
+ * @param initialstate 量子状態ベクトル（2^numQubits × 2要素、単精度モードではfloat配列、
+ *                     SoAレイアウトでは前半が実部・後半が虚部）
+ * @param stateParams 状態パラメータ作業配列
+ * @param gatePacks ゲート行列要素配列（8要素×6ゲート）
+ * @param gates ゲートID配列（gatePacksの並び、初期化時にcalculatGateStateが設定）
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照）
+ * @param densityMatrix 密度行列結果配列（8要素×numQubits）
+ * @param gateKinds ゲート種類配列（6要素、初期化時にcalculatGateStateが設定）
+ * @param timeBudget 1回の呼び出しの時間予算のポインタ（ミリ秒、0で無制限、calculateMainState 参照）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void sumDoubleArray(
+    double* floatArray, 
+    int* gateCircuitData, 
+    int* lengthintPointer, 
+    int* numQubitsPointer, 
+    int* cutintPointer, 
+    double* /* resultShared（未使用） */, 
+    int* progressShared, 
+    uint64_t* boolShared, 
+    double* initialstate,
+    double* stateParams,
+    double* gatePacks,
+    int* gates,
+    int* circuitOps,
+    double* densityMatrix,
+    int* gateKinds,
+    double* timeBudget) {
+
+    // JavaScript側からの入力パラメータを取得
+    int lengthint = *lengthintPointer;     // 回路データの総長さ
+    int numQubits = *numQubitsPointer;     // 量子ビット数
+    int cutint = *cutintPointer;           // 実行制御パラメータ
+    *boolShared &= ~(1ULL << 8);           // 中断フラグをクリア
+
+    // フェーズ別計測が有効な場合は呼び出しごとにカウンタをリセット
+    if (phaseCounters){
+        fill(phaseCounters + 1, phaseCounters + COUNTER_LENGTH, 0.0);
+        phaseCounters[COUNTER_SEQUENCE] += 1;
+    }
+    PhaseTimer totalTimer(COUNTER_TOTAL_MS);
+
+    // 単精度モード（ビット4）では状態ベクトル領域をfloat配列として扱う
+    bool singlePrecision = (*boolShared & (1ULL << 4)) != 0;
+    float* singleState = reinterpret_cast<float*>(initialstate);
+
+    // SoAレイアウト（ビット5）では状態ベクトル領域を実部配列・虚部配列に分けて扱う
+    bool splitLayout = (*boolShared & (1ULL << 5)) != 0;
+    size_t amplitudes = static_cast<size_t>(1) << numQubits;
+
+    // 精度とレイアウトに応じた状態ベクトルで処理を実体化
+    auto withState = [&](auto process){
+        if (splitLayout){
+            if (singlePrecision){
+                process(SplitState<float>{singleState, singleState + amplitudes});
+            }else{
+                process(SplitState<double>{initialstate, initialstate + amplitudes});
+            }
+        }else if (singlePrecision){
+            process(singleState);
+        }else{
+            process(initialstate);
+        }
+    };
+
+    // 初期化フラグがセットされている場合
+    if(*boolShared & (1ULL << 1)){
+        PhaseTimer initializeTimer(COUNTER_INITIALIZE_MS);
+
+        // 回転角パラメータを計算
+        double theta = M_PI / (cutint == 0 ? 1 : cutint);
+        
+        // 各種ゲートの行列要素を事前計算
+        calculatGateState(theta, gatePacks, gates, gateKinds);
+
+        // H/S/X/Y/Z/CNOT だけの回路（通常実行）はタブローで実行し、状態ベクトルは結果から書き出す
+        // 書き出しは生成元ごとの走査（numQubits回）のため、ゲート数が量子ビット数を超える場合のみ
+        // （浅い回路は疎表現・状態ベクトルで実行）
+        int opCount = circuitOps[1 + circuitOps[0]];
+        if (cutint == 0 && !(*boolShared & (1ULL << 6)) && opCount > numQubits &&
+            runStabilizerCircuit(stabilizerTableau, floatArray, numQubits, gatePacks, circuitOps)){
+            PhaseTimer traceTimer(COUNTER_TRACE_MS);
+            withState([&](auto state){
+                exportStabilizerState(stabilizerTableau, state);
+            });
+            calculateStabilizerTrace(stabilizerTableau, densityMatrix);
+            *progressShared = lengthint / numQubits;
+            *boolShared |= (1ULL << 7);   // 完了フラグを設定
+            *boolShared &= ~(1ULL << 1);  // 初期化フラグをクリア
+            return;
+        }
+        
+        // 量子状態を初期化（通常実行では変更箇所より前のチェックポイントがあればそこから再開）
+        // 通常実行・全リピート実行で非ゼロの振幅が少ない場合は疎表現から開始
+        int resumeRow = 0;
+        bool fullRun = cutint == 0 || ((*boolShared & (1ULL << 2)) && (*boolShared & (1ULL << 3)));
+        sparseRegister.active = false;
+        if (*boolShared & (1ULL << 6)){
+            // クラスタモードでは各量子ビットの2要素ベクトルだけを用意
+            initializeClusters(clusterRegister, floatArray, numQubits, stateParams);
+        }else{
+            withState([&](auto state){
+                resumeRow = cutint == 0 ? restoreCheckpoint(state, floatArray, gateCircuitData, lengthint, numQubits, singlePrecision) : 0;
+                if (resumeRow == 0 && !(fullRun && initializeSparse(sparseRegister, floatArray, numQubits, stateParams))){
+                    initialize(floatArray, numQubits, state, stateParams);
+                }
+            });
+        }
+          // プログレス関連の初期化
+        *progressShared = resumeRow;
+        *boolShared &= ~(1ULL << 7);  // 完了フラグをクリア
+        *boolShared &= ~(1ULL << 1);  // 初期化フラグをクリア
+    }
+
+    // 量子状態演算のメイン実行（状態ベクトルの精度・レイアウトに応じて実体化）
+    withState([&](auto state){
+        calculateMainState(
+            state, 
+            numQubits, 
+            gatePacks, 
+            gateKinds,
+            circuitOps, 
+            cutint, 
+            progressShared, 
+            boolShared, 
+            lengthint,
+            densityMatrix,
+            *timeBudget);
+    });
+}
+
+/**
+ * @brief 振幅の確率 |amp|² を返す（レイアウト別）
+ */
+template <typename Real>
+inline double amplitudeProbability(const Real* state, size_t index){
+    double re = state[2 * index];
+    double im = state[2 * index + 1];
+    return re * re + im * im;
+}
+
+template <typename Real>
+inline double amplitudeProbability(SplitState<Real> state, size_t index){
+    double re = state.re[index];
+    double im = state.im[index];
+    return re * re + im * im;
+}
+
+/**
+ * @brief 確率分布から shots 回の標本を引く
+ *
+ * 区間ごとの確率の合計を1回の走査で求め、昇順に並べた一様乱数を区間ごとに割り当てます。
+ * 2^n 要素の累積和表を持たないため、追加のメモリは区間数と shots に比例する分だけです。
+ *
+ * @param probability 基底番号 → 確率を返す関数
+ * @param size 基底の数
+ * @param shots 標本数
+ * @param rng 乱数生成器
+ * @return 基底番号の昇順に並んだ標本
+ */
+template <typename Probability>
+vector<uint32_t> drawSortedSamples(Probability probability, size_t size, int shots, mt19937_64& rng){
+    // 区間ごとの確率の合計（区間数を固定して、スレッド数によらず同じ結果にする）
+    size_t chunk = max<size_t>(size >> 8, 1);
+    int chunks = static_cast<int>((size + chunk - 1) / chunk);
+    vector<double> chunkStart(chunks + 1, 0.0);
+    parallelFor(chunks, [&](int, int begin, int end){
+        for (int c = begin; c < end; ++c){
+            double sum = 0.0;
+            for (size_t i = c * chunk; i < min(size, (c + 1) * chunk); ++i){
+                sum += probability(i);
+            }
+            chunkStart[c + 1] = sum;
+        }
+    });
+    for (int c = 0; c < chunks; ++c){
+        chunkStart[c + 1] += chunkStart[c];
+    }
+
+    // 合計確率の範囲で一様乱数を引いて昇順に整列
+    uniform_real_distribution<double> uniform(0.0, chunkStart[chunks]);
+    vector<double> draws(shots);
+    for (double& draw : draws){
+        draw = uniform(rng);
+    }
+    sort(draws.begin(), draws.end());
+
+    // 区間内を順に走査して各乱数が落ちる基底を求める
+    vector<uint32_t> samples(shots);
+    parallelFor(chunks, [&](int, int begin, int end){
+        for (int c = begin; c < end; ++c){
+            auto first = lower_bound(draws.begin(), draws.end(), chunkStart[c]);
+            auto last = c + 1 == chunks ? draws.end() : lower_bound(first, draws.end(), chunkStart[c + 1]);
+            size_t i = c * chunk;
+            size_t iEnd = min(size, (c + 1) * chunk);
+            double accumulated = chunkStart[c];
+            for (auto draw = first; draw != last; ++draw){
+                while (i + 1 < iEnd && accumulated + probability(i) <= *draw){
+                    accumulated += probability(i);
+                    ++i;
+                }
+                samples[draw - draws.begin()] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+    return samples;
+}
+
+static vector<int32_t> sampleCounts; // sampleMeasurements の結果（WASM用、次の呼び出しまで有効）
+
+/**
+ * @brief 状態ベクトルから測定結果を shots 回サンプリングし、結果ごとの回数を呼び出し元の配列に書き込む
+ *
+ * 結果の番号は測定する量子ビットを番号の昇順に並べ、最初の量子ビットを最上位ビットとした値です
+ * （全量子ビットを測定する場合は基底番号と同じ）。
+ * クラスタモードで全体の状態ベクトルに展開していない場合は、独立なクラスタごとに標本を引いて組み合わせます。
+ *
+ * @param state 量子状態ベクトル（sumDoubleArray の initialstate と同じ領域）
+ * @param numQubits 量子ビット数
+ * @param flags 状態ベクトルの形式（boolShared と同じビット、ビット4 = 単精度、ビット5 = SoA、ビット6 = クラスタ）
+ * @param qubitMask 測定する量子ビットのマスク（ビットq = 量子ビットq）
+ * @param shots 測定回数
+ * @param seed 乱数の種
+ * @param counts 結果ごとの回数（2^popcount(qubitMask) 要素、量子ビット数の範囲外のビットは除いた数）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void sampleMeasurementsInto(double* state, int numQubits, int flags, uint32_t qubitMask, int shots, uint32_t seed, int32_t* counts){
+    qubitMask &= (numQubits >= 32 ? ~0u : (1u << numQubits) - 1);
+    int measured = __builtin_popcount(qubitMask);
+    fill(counts, counts + (static_cast<size_t>(1) << measured), 0);
+    if (shots <= 0){
+        return;
+    }
+
+    // 量子ビット番号 → 結果の番号でのビット位置
+    int outcomeBit[32];
+    for (int q = 0, rank = 0; q < numQubits; ++q){
+        outcomeBit[q] = (qubitMask >> q) & 1 ? measured - 1 - rank++ : -1;
+    }
+
+    mt19937_64 rng(seed);
+    vector<uint32_t> outcomes(shots, 0);
+
+    if ((flags & (1 << 6)) && !clusterRegister.promoted){
+        // クラスタごとに独立に標本を引き、並びを混ぜてから結果のビットを合成
+        for (const QubitCluster& cluster : clusterRegister.clusters){
+            int size = static_cast<int>(cluster.qubits.size());
+            bool touched = false;
+            for (int q : cluster.qubits){
+                touched = touched || outcomeBit[q] >= 0;
+            }
+            if (!touched){
+                continue;
+            }
+            vector<uint32_t> samples = drawSortedSamples([&](size_t i){ return norm(cluster.amplitudes[i]); },
+                                                         cluster.amplitudes.size(), shots, rng);
+            shuffle(samples.begin(), samples.end(), rng);
+            for (int s = 0; s < shots; ++s){
+                for (int k = 0; k < size; ++k){
+                    int bit = outcomeBit[cluster.qubits[k]];
+                    if (bit >= 0){
+                        outcomes[s] |= ((samples[s] >> (size - k - 1)) & 1u) << bit;
+                    }
+                }
+            }
+        }
+    }else{
+        // 全体の状態ベクトルから基底番号を引き、測定する量子ビットのビットを取り出す
+        bool singlePrecision = (flags & (1 << 4)) != 0;
+        bool splitLayout = (flags & (1 << 5)) != 0;
+        float* singleState = reinterpret_cast<float*>(state);
+        size_t amplitudes = static_cast<size_t>(1) << numQubits;
+        auto sample = [&](auto view){
+            return drawSortedSamples([&](size_t i){ return amplitudeProbability(view, i); }, amplitudes, shots, rng);
+        };
+        vector<uint32_t> samples;
+        if (splitLayout){
+            samples = singlePrecision ? sample(SplitState<float>{singleState, singleState + amplitudes})
+                                      : sample(SplitState<double>{state, state + amplitudes});
+        }else{
+            samples = singlePrecision ? sample(static_cast<const float*>(singleState)) : sample(static_cast<const double*>(state));
+        }
+        for (int s = 0; s < shots; ++s){
+            for (int q = 0; q < numQubits; ++q){
+                if (outcomeBit[q] >= 0){
+                    outcomes[s] |= ((samples[s] >> (numQubits - q - 1)) & 1u) << outcomeBit[q];
+                }
+            }
+        }
+    }
+
+    for (uint32_t outcome : outcomes){
+        ++counts[outcome];
+    }
+}
+
+/**
+ * @brief 測定サンプリングの結果をエンジン内の配列に書き込む（Workerの制御ブロック経由の呼び出し用）
+ *
+ * 引数は sampleMeasurementsInto と同じです。Workerは1件ずつ順に実行するため、
+ * 結果はエンジン内の配列（次の呼び出しまで有効）に書き込みます。
+ * 複数のスレッドから呼び出すホスト（ネイティブ共有ライブラリ）は sampleMeasurementsInto を使います。
+ *
+ * @return 結果ごとの回数（2^popcount(qubitMask) 要素）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE int32_t* sampleMeasurements(double* state, int numQubits, int flags, uint32_t qubitMask, int shots, uint32_t seed){
+    uint32_t mask = qubitMask & (numQubits >= 32 ? ~0u : (1u << numQubits) - 1);
+    sampleCounts.resize(static_cast<size_t>(1) << __builtin_popcount(mask));
+    sampleMeasurementsInto(state, numQubits, flags, qubitMask, shots, seed, sampleCounts.data());
+    return sampleCounts.data();
+}
+
+/**
+ * @brief 任意の2×2ゲート行列を状態ベクトルに適用する（ネイティブ共有ライブラリ用）
+ *
+ * Python側（qcal_native.py）から numpy の complex128 配列をそのまま渡して呼び出します。
+ * complex128 は実部・虚部交互配列と同じメモリ配置です。
+ *
+ * @param state 量子状態ベクトル（更新対象）
+ * @param numQubits 量子ビット数
+ * @param targetQubit 対象量子ビット番号
+ * @param controlOnes |1⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param controlZeros |0⟩を条件とする制御ビットのマスク（ビットq = 量子ビットq）
+ * @param pack ゲート行列要素 [T₀₀r, T₀₀i, T₀₁r, T₀₁i, T₁₀r, T₁₀i, T₁₁r, T₁₁i]
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void applyGateMatrix(double* state, int numQubits, int targetQubit, uint32_t controlOnes, uint32_t controlZeros, const double* pack){
+    calculateState(state, pack, classifyGatePack(pack), controlOnes, controlZeros, numQubits, targetQubit);
+}
+
+/**
+ * @brief 全量子ビットの密度行列を計算する（ネイティブ共有ライブラリ用）
+ *
+ * densityMatrixは量子ビットごとに8要素で、complex128の2×2行列
+ * [[ρ₀₀, ρ₀₁], [ρ₁₀, ρ₁₁]] と同じメモリ配置です。
+ *
+ * @param state 量子状態ベクトル
+ * @param numQubits 量子ビット数
+ * @param densityMatrix 出力用密度行列配列（8要素×numQubits）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void calculateDensityMatrices(double* state, int numQubits, double* densityMatrix){
+    calculateTraceState(state, numQubits, densityMatrix);
+}
+
+/**
+ * @brief 2量子ビットの縮約密度行列（4×4）を計算する
+ *
+ * 行・列番号は 2·(qubitAのビット) + (qubitBのビット) です。
+ * 2つのビット以外を固定ビット列挙で走査し、4振幅の外積を累積します。
+ *
+ * @param state 量子状態ベクトル
+ * @param numQubits 量子ビット数
+ * @param qubitA 1つ目の量子ビット番号（上位側の添字）
+ * @param qubitB 2つ目の量子ビット番号（下位側の添字）
+ * @param rho 出力用4×4複素行列（行優先16要素）
+ */
+template <typename Real>
+void calculatePairDensityMatrix(const Real* state, int numQubits, int qubitA, int qubitB, complex<double>* rho){
+    unsigned int bitA = 1u << (numQubits-qubitA-1);
+    unsigned int bitB = 1u << (numQubits-qubitB-1);
+    unsigned int fixedMask = bitA | bitB;
+    const unsigned int offsets[4] = {0, bitB, bitA, bitA | bitB};
+    vector<complex<double>> partialRho(MAX_THREADS * 16); // スレッドごとの部分和
+
+    int usedThreads = parallelFor(1 << (numQubits-2), [&](int t, int begin, int end){
+        complex<double>* sum = &partialRho[t * 16];
+        unsigned int index = insertZeroBits(begin, fixedMask);
+        for (int k = begin; k < end; ++k){
+            complex<double> amp[4];
+            for (int a = 0; a < 4; ++a){
+                unsigned int j2 = (index | offsets[a]) << 1;
+                amp[a] = complex<double>(state[j2], state[j2 | 1]);
+            }
+            for (int a = 0; a < 4; ++a){
+                for (int b = 0; b < 4; ++b){
+                    sum[a*4+b] += amp[a] * conj(amp[b]);
+                }
+            }
+            index = ((index | fixedMask) + 1) & ~fixedMask;
+        }
+    });
+    for (int e = 0; e < 16; ++e){
+        rho[e] = 0;
+        for (int t = 0; t < usedThreads; ++t){
+            rho[e] += partialRho[t * 16 + e];
+        }
+    }
+}
+
+/**
+ * @brief 1量子ビットの密度行列（2×2）を計算する
+ *
+ * @param state 量子状態ベクトル
+ * @param numQubits 量子ビット数
+ * @param qubit 量子ビット番号
+ * @param rho 出力用2×2複素行列（ρ[a][b] = Σ sₐ·conj(s_b)）
+ */
+template <typename Real>
+void calculateQubitDensityMatrix(const Real* state, int numQubits, int qubit, complex<double>* rho){
+    int m = 1 << (numQubits-qubit-1);
+    double zero[MAX_THREADS] = {};
+    double one[MAX_THREADS] = {};
+    complex<double> offDiagonal[MAX_THREADS];
+    int usedThreads = parallelFor(1 << (numQubits-1), [&](int t, int begin, int end){
+        offDiagonal[t] = sumOffDiagonal(state, begin, end, m << 1, m-1, ~(m-1));
+        for (int j = begin; j < end; ++j){
+            int i00 = (((j & ~(m-1)) << 1) | (j & (m-1))) << 1;
+            zero[t] += amplitudeNorm(state, i00);
+            one[t] += amplitudeNorm(state, i00 | (m << 1));
+        }
+    });
+    rho[0] = rho[1] = rho[3] = 0;
+    for (int t = 0; t < usedThreads; ++t){
+        rho[0] += zero[t];
+        rho[1] += offDiagonal[t];
+        rho[3] += one[t];
+    }
+    rho[2] = conj(rho[1]);
+}
+
+/**
+ * @brief 2×2密度行列からブロッホ座標 (x, y, z) を求める（func_2.CoordinateCalcと同じ定義）
+ */
+inline void blochCoordinate(const complex<double>* rho, double* coordinate){
+    coordinate[0] = 2*rho[2].real();
+    coordinate[1] = 2*rho[2].imag();
+    coordinate[2] = fabs(2*rho[0].real()) - 1;
+}
+
+/**
+ * @brief 候補ゲート群を1量子ビットに適用した結果のブロッホ座標をまとめて計算する
+ *
+ * 状態ベクトルのコピーは作らず、縮約密度行列を1回だけ計算して
+ * 各候補 U について ρ' = U·ρ·U† を求めます。
+ * controlQubit ≥ 0 の場合は U の適用後に CNOT（controlQubit → targetQubit）を適用し、
+ * 2量子ビットの縮約密度行列（4×4）から両ビットの座標を求めます。
+ *
+ * @param state 基準の量子状態ベクトル（変更しない）
+ * @param numQubits 量子ビット数
+ * @param targetQubit 候補ゲートを適用する量子ビット番号
+ * @param controlQubit CNOTの制御ビット番号（-1 = CNOTなし）
+ * @param packs 候補ゲート行列（8要素×count、gatePacksと同じ並び）
+ * @param count 候補数
+ * @param coordinates 出力：候補ごとに [targetのx, y, z, controlのx, y, z]（CNOTなしの場合control側は0）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void evaluateGateCandidates(const double* state, int numQubits, int targetQubit, int controlQubit, const double* packs, int count, double* coordinates){
+    if (controlQubit < 0){
+        complex<double> rho[4];
+        calculateQubitDensityMatrix(state, numQubits, targetQubit, rho);
+        for (int k = 0; k < count; ++k){
+            const double* pack = packs + 8*k;
+            const complex<double> u[4] = {{pack[0], pack[1]}, {pack[2], pack[3]}, {pack[4], pack[5]}, {pack[6], pack[7]}};
+            complex<double> newRho[4];
+            for (int a = 0; a < 2; ++a){
+                for (int b = 0; b < 2; ++b){
+                    complex<double> sum = 0;
+                    for (int c = 0; c < 2; ++c){
+                        for (int d = 0; d < 2; ++d){
+                            sum += u[a*2+c] * rho[c*2+d] * conj(u[b*2+d]);
+                        }
+                    }
+                    newRho[a*2+b] = sum;
+                }
+            }
+            blochCoordinate(newRho, coordinates + 6*k);
+            coordinates[6*k+3] = coordinates[6*k+4] = coordinates[6*k+5] = 0.0;
+        }
+        return;
+    }
+
+    // 行・列番号 = 2·(制御ビット) + (ターゲットビット)
+    complex<double> rho[16];
+    calculatePairDensityMatrix(state, numQubits, controlQubit, targetQubit, rho);
+    const int cnotRow[4] = {0, 1, 3, 2}; // CNOTは制御ビット=1の行を入れ替える
+    for (int k = 0; k < count; ++k){
+        const double* pack = packs + 8*k;
+        const complex<double> u[4] = {{pack[0], pack[1]}, {pack[2], pack[3]}, {pack[4], pack[5]}, {pack[6], pack[7]}};
+
+        // M = CNOT·(I⊗U)
+        complex<double> gate[16];
+        for (int r = 0; r < 4; ++r){
+            int row = cnotRow[r];
+            for (int c = 0; c < 4; ++c){
+                gate[r*4+c] = (row >> 1) == (c >> 1) ? u[(row & 1)*2 + (c & 1)] : complex<double>(0);
+            }
+        }
+
+        // ρ' = M·ρ·M†
+        complex<double> temp[16], newRho[16];
+        for (int r = 0; r < 4; ++r){
+            for (int c = 0; c < 4; ++c){
+                complex<double> sum = 0;
+                for (int e = 0; e < 4; ++e){
+                    sum += gate[r*4+e] * rho[e*4+c];
+                }
+                temp[r*4+c] = sum;
+            }
+        }
+        for (int r = 0; r < 4; ++r){
+            for (int c = 0; c < 4; ++c){
+                complex<double> sum = 0;
+                for (int e = 0; e < 4; ++e){
+                    sum += temp[r*4+e] * conj(gate[c*4+e]);
+                }
+                newRho[r*4+c] = sum;
+            }
+        }
+
+        // 部分トレースで各ビットの2×2密度行列を求める
+        complex<double> targetRho[4], controlRho[4];
+        for (int a = 0; a < 2; ++a){
+            for (int b = 0; b < 2; ++b){
+                targetRho[a*2+b] = newRho[a*4+b] + newRho[(2+a)*4+(2+b)];
+                controlRho[a*2+b] = newRho[(2*a)*4+(2*b)] + newRho[(2*a+1)*4+(2*b+1)];
+            }
+        }
+        blochCoordinate(targetRho, coordinates + 6*k);
+        blochCoordinate(controlRho, coordinates + 6*k + 3);
+    }
+}
+
+/**
+ * @brief 複数の量子ビット対の縮約密度行列（4×4）を1回の走査でまとめて計算する
+ *
+ * 状態ベクトルを先頭から順に走査し、各対の2ビットが0の位置で4振幅の外積（上三角）を累積します。
+ * 対ごとに走査し直す場合と比べて、状態ベクトルの読み込みが1回で済みます。
+ * 行・列番号は calculatePairDensityMatrix と同じ 2·(qubitAのビット) + (qubitBのビット) です。
+ *
+ * @param state 量子状態ベクトル（Real* またはSplitState）
+ * @param numQubits 量子ビット数
+ * @param pairs 量子ビット対 [A₀, B₀, A₁, B₁, ...]（A ≠ B）
+ * @param pairCount 対の数
+ * @param rho 出力用4×4複素行列（行優先16要素×pairCount）
+ */
+template <typename State>
+void calculatePairDensityMatrices(State state, int numQubits, const int32_t* pairs, int pairCount, complex<double>* rho){
+    vector<unsigned int> offsets(4 * pairCount); // 対ごとの4振幅のオフセット
+    vector<unsigned int> masks(pairCount);       // 対ごとの2ビットのマスク
+    for (int p = 0; p < pairCount; ++p){
+        unsigned int bitA = 1u << (numQubits - pairs[2*p] - 1);
+        unsigned int bitB = 1u << (numQubits - pairs[2*p+1] - 1);
+        masks[p] = bitA | bitB;
+        offsets[4*p] = 0;
+        offsets[4*p+1] = bitB;
+        offsets[4*p+2] = bitA;
+        offsets[4*p+3] = bitA | bitB;
+    }
+    vector<complex<double>> partialRho(static_cast<size_t>(MAX_THREADS) * 16 * pairCount); // スレッドごとの部分和
+
+    int usedThreads = parallelFor(1 << numQubits, [&](int t, int begin, int end){
+        complex<double>* sum = &partialRho[static_cast<size_t>(t) * 16 * pairCount];
+        for (int i = begin; i < end; ++i){
+            for (int p = 0; p < pairCount; ++p){
+                if (i & masks[p]){
+                    continue;
+                }
+                complex<double> amp[4];
+                for (int a = 0; a < 4; ++a){
+                    amp[a] = loadAmplitude(state, i | offsets[4*p+a]);
+                }
+                for (int a = 0; a < 4; ++a){
+                    for (int b = a; b < 4; ++b){
+                        sum[16*p + a*4+b] += amp[a] * conj(amp[b]);
+                    }
+                }
+            }
+        }
+    });
+
+    // スレッドごとの部分和を合計し、下三角はエルミート共役で埋める
+    for (int p = 0; p < pairCount; ++p){
+        complex<double>* r = rho + 16*p;
+        for (int a = 0; a < 4; ++a){
+            for (int b = a; b < 4; ++b){
+                complex<double> total = 0;
+                for (int t = 0; t < usedThreads; ++t){
+                    total += partialRho[static_cast<size_t>(t) * 16 * pairCount + 16*p + a*4+b];
+                }
+                r[a*4+b] = total;
+                r[b*4+a] = conj(total);
+            }
+        }
+    }
+}
+
+/**
+ * @brief 8×8実対称行列の固有値・固有ベクトルを求める（巡回ヤコビ法）
+ *
+ * @param a 対称行列（破壊される）
+ * @param values 出力：固有値
+ * @param vectors 出力：固有ベクトル（列ベクトル）
+ */
+void symmetricEigen8(double a[8][8], double values[8], double vectors[8][8]){
+    for (int i = 0; i < 8; ++i){
+        for (int j = 0; j < 8; ++j){
+            vectors[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 64; ++sweep){
+        double off = 0.0;
+        for (int i = 0; i < 8; ++i){
+            for (int j = i + 1; j < 8; ++j){
+                off += a[i][j] * a[i][j];
+            }
+        }
+        if (off < 1e-30){
+            break;
+        }
+        for (int p = 0; p < 8; ++p){
+            for (int q = p + 1; q < 8; ++q){
+                if (fabs(a[p][q]) < 1e-300){
+                    continue;
+                }
+                // a[p][q] を0にする回転角
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1));
+                double c = 1 / sqrt(t * t + 1);
+                double s = t * c;
+                for (int k = 0; k < 8; ++k){
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 8; ++k){
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 8; ++k){
+                    double vkp = vectors[k][p], vkq = vectors[k][q];
+                    vectors[k][p] = c * vkp - s * vkq;
+                    vectors[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 8; ++i){
+        values[i] = a[i][i];
+    }
+}
+
+/**
+ * @brief 4×4複素行列を8×8実行列 [[Re, −Im], [Im, Re]] に埋め込む
+ *
+ * 積・エルミート性を保つため、エルミート行列の固有値は実対称行列の固有値（各2重）として求まります。
+ */
+inline void embedComplex4(const complex<double>* m, double out[8][8]){
+    for (int r = 0; r < 4; ++r){
+        for (int c = 0; c < 4; ++c){
+            out[r][c] = out[r+4][c+4] = m[r*4+c].real();
+            out[r+4][c] = m[r*4+c].imag();
+            out[r][c+4] = -m[r*4+c].imag();
+        }
+    }
+}
+
+/**
+ * @brief 2量子ビット密度行列の concurrence（Wootters）を計算する
+ *
+ * R = √ρ·ρ̃·√ρ（ρ̃ = (σy⊗σy)·ρ*·(σy⊗σy)）の固有値の平方根 λ₁ ≥ λ₂ ≥ λ₃ ≥ λ₄ から
+ * max(0, λ₁−λ₂−λ₃−λ₄) を求めます。
+ *
+ * @param rho 4×4複素行列（行優先16要素）
+ * @return concurrence（0 = 分離可能、1 = 最大エンタングル）
+ */
+double pairConcurrence(const complex<double>* rho){
+    // √ρ：ρの固有分解から作成（埋め込んだ実行列のまま計算）
+    double a[8][8], values[8], vectors[8][8], root[8][8];
+    embedComplex4(rho, a);
+    symmetricEigen8(a, values, vectors);
+    for (int i = 0; i < 8; ++i){
+        for (int j = 0; j < 8; ++j){
+            double sum = 0.0;
+            for (int k = 0; k < 8; ++k){
+                sum += vectors[i][k] * sqrt(max(values[k], 0.0)) * vectors[j][k];
+            }
+            root[i][j] = sum;
+        }
+    }
+
+    // ρ̃[a][b] = s_a·s_b·conj(ρ[3−a][3−b])（σy⊗σy の符号 s = {−1, 1, 1, −1}）
+    const double sign[4] = {-1.0, 1.0, 1.0, -1.0};
+    complex<double> flipped[16];
+    for (int r = 0; r < 4; ++r){
+        for (int c = 0; c < 4; ++c){
+            flipped[r*4+c] = sign[r] * sign[c] * conj(rho[(3-r)*4 + (3-c)]);
+        }
+    }
+    double f[8][8], temp[8][8], product[8][8];
+    embedComplex4(flipped, f);
+    for (int i = 0; i < 8; ++i){
+        for (int j = 0; j < 8; ++j){
+            double sum = 0.0;
+            for (int k = 0; k < 8; ++k){
+                sum += root[i][k] * f[k][j];
+            }
+            temp[i][j] = sum;
+        }
+    }
+    for (int i = 0; i < 8; ++i){
+        for (int j = 0; j < 8; ++j){
+            double sum = 0.0;
+            for (int k = 0; k < 8; ++k){
+                sum += temp[i][k] * root[k][j];
+            }
+            product[i][j] = sum;
+        }
+    }
+
+    // 固有値は各2重に現れるため、降順に並べて1つおきに取る
+    symmetricEigen8(product, values, vectors);
+    sort(values, values + 8, greater<double>());
+    double lambda[4];
+    for (int i = 0; i < 4; ++i){
+        lambda[i] = sqrt(max(values[2*i], 0.0));
+    }
+    return max(0.0, lambda[0] - lambda[1] - lambda[2] - lambda[3]);
+}
+
+/**
+ * @brief 量子ビット対の指標1件当たりの要素数（4×4複素行列32要素 + concurrence + purity）
+ */
+constexpr int PAIR_METRIC_SIZE = 34;
+
+static vector<double> pairMetricResults; // calculatePairMetrics の計算結果（WASM用、次の呼び出しまで有効）
+
+/**
+ * @brief 量子ビット対の縮約密度行列（4×4）と concurrence・purity を呼び出し元の配列に計算する
+ *
+ * 全ての対の縮約密度行列を状態ベクトルの1回の走査で求めます。
+ * クラスタモードで全体の状態ベクトルに展開していない場合は、同じクラスタの対はクラスタの結合状態から、
+ * 異なるクラスタの対は1量子ビットの密度行列のテンソル積（concurrence = 0）として求めます。
+ *
+ * @param state 量子状態ベクトル（sumDoubleArray の initialstate と同じ領域）
+ * @param numQubits 量子ビット数
+ * @param flags 状態ベクトルの形式（sampleMeasurements と同じ）
+ * @param pairs 量子ビット対 [A₀, B₀, A₁, B₁, ...]（行・列番号 = 2·(Aのビット) + (Bのビット)）
+ * @param pairCount 対の数
+ * @param results 結果の配列（PAIR_METRIC_SIZE × pairCount 要素）。対ごとに
+ *                [ρ（complex128の4×4行優先、32要素）, concurrence, purity = Tr(ρ²)]（量子ビット番号が不正な対は全て0）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE void calculatePairMetricsInto(double* state, int numQubits, int flags, const int32_t* pairs, int pairCount, double* results){
+    fill(results, results + static_cast<size_t>(PAIR_METRIC_SIZE) * max(pairCount, 0), 0.0);
+    vector<int32_t> valid;  // 計算する対
+    vector<int> slots;      // 計算する対の結果位置
+    for (int p = 0; p < pairCount; ++p){
+        int a = pairs[2*p], b = pairs[2*p+1];
+        if (a >= 0 && b >= 0 && a < numQubits && b < numQubits && a != b){
+            valid.push_back(a);
+            valid.push_back(b);
+            slots.push_back(p);
+        }
+    }
+    int count = static_cast<int>(slots.size());
+    vector<complex<double>> rho(16 * static_cast<size_t>(count));
+
+    if ((flags & (1 << 6)) && !clusterRegister.promoted){
+        for (int k = 0; k < count; ++k){
+            int a = valid[2*k], b = valid[2*k+1];
+            const QubitCluster& clusterA = clusterRegister.clusters[clusterRegister.clusterOf[a]];
+            const QubitCluster& clusterB = clusterRegister.clusters[clusterRegister.clusterOf[b]];
+            if (&clusterA == &clusterB){
+                // 同じクラスタ：局所番号で結合状態から計算
+                const int32_t local[2] = {clusterRegister.localOf[a], clusterRegister.localOf[b]};
+                calculatePairDensityMatrices(reinterpret_cast<const double*>(clusterA.amplitudes.data()),
+                                             static_cast<int>(clusterA.qubits.size()), local, 1, &rho[16*k]);
+            }else{
+                // 異なるクラスタ：ρ = ρA ⊗ ρB
+                complex<double> rhoA[4], rhoB[4];
+                calculateQubitDensityMatrix(reinterpret_cast<const double*>(clusterA.amplitudes.data()),
+                                            static_cast<int>(clusterA.qubits.size()), clusterRegister.localOf[a], rhoA);
+                calculateQubitDensityMatrix(reinterpret_cast<const double*>(clusterB.amplitudes.data()),
+                                            static_cast<int>(clusterB.qubits.size()), clusterRegister.localOf[b], rhoB);
+                for (int r = 0; r < 4; ++r){
+                    for (int c = 0; c < 4; ++c){
+                        rho[16*k + r*4+c] = rhoA[(r >> 1)*2 + (c >> 1)] * rhoB[(r & 1)*2 + (c & 1)];
+                    }
+                }
+            }
+        }
+    }else if (count > 0){
+        bool singlePrecision = (flags & (1 << 4)) != 0;
+        bool splitLayout = (flags & (1 << 5)) != 0;
+        float* singleState = reinterpret_cast<float*>(state);
+        size_t amplitudes = static_cast<size_t>(1) << numQubits;
+        if (splitLayout){
+            if (singlePrecision){
+                calculatePairDensityMatrices(SplitState<float>{singleState, singleState + amplitudes}, numQubits, valid.data(), count, rho.data());
+            }else{
+                calculatePairDensityMatrices(SplitState<double>{state, state + amplitudes}, numQubits, valid.data(), count, rho.data());
+            }
+        }else if (singlePrecision){
+            calculatePairDensityMatrices(static_cast<const float*>(singleState), numQubits, valid.data(), count, rho.data());
+        }else{
+            calculatePairDensityMatrices(static_cast<const double*>(state), numQubits, valid.data(), count, rho.data());
+        }
+    }
+
+    for (int k = 0; k < count; ++k){
+        double* out = results + static_cast<size_t>(PAIR_METRIC_SIZE) * slots[k];
+        double purity = 0.0;
+        for (int e = 0; e < 16; ++e){
+            out[2*e] = rho[16*k + e].real();
+            out[2*e+1] = rho[16*k + e].imag();
+            purity += norm(rho[16*k + e]);
+        }
+        out[32] = pairConcurrence(&rho[16*k]);
+        out[33] = purity;
+    }
+}
+
+/**
+ * @brief 量子ビット対の指標をエンジン内の配列に計算する（Workerの制御ブロック経由の呼び出し用）
+ *
+ * 引数は calculatePairMetricsInto と同じです。Workerは1件ずつ順に実行するため、
+ * 結果はエンジン内の配列（次の呼び出しまで有効）に書き込みます。
+ * 複数のスレッドから呼び出すホスト（ネイティブ共有ライブラリ）は calculatePairMetricsInto を使います。
+ *
+ * @return 対ごとの結果（calculatePairMetricsInto の results と同じ並び）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE double* calculatePairMetrics(double* state, int numQubits, int flags, const int32_t* pairs, int pairCount){
+    pairMetricResults.resize(static_cast<size_t>(PAIR_METRIC_SIZE) * max(pairCount, 0));
+    calculatePairMetricsInto(state, numQubits, flags, pairs, pairCount, pairMetricResults.data());
+    return pairMetricResults.data();
+}
+
+/**
+ * @brief 演算リストの全ての行を状態ベクトルに1回ずつ適用する（リピート・部分実行なし）
+ *
+ * sumDoubleArray の通常実行（cutint = 0）と同じ順序でゲートを融合・適用します。
+ * 共有の実行待ち列（fusionQueue）やチェックポイントには触れません。
+ *
+ * @param state 量子状態ベクトル（Real* またはSplitState）
+ * @param numQubits 量子ビット数
+ * @param gatePacks ゲート行列要素配列（calculatGateState の出力）
+ * @param gateKinds ゲート種類配列
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照）
+ */
+template <typename State>
+void runCircuitOps(State state, int numQubits, const double* gatePacks, const int* gateKinds, const int* circuitOps){
+    const int* rowStart = circuitOps + 1;
+    const int* ops = circuitOps + 2 + circuitOps[0];
+    vector<FusedGate> queue;
+    for (int k = 0; k < rowStart[circuitOps[0]]; ++k){
+        const int* op = ops + CIRCUIT_OP_SIZE * k;
+        FusedGate gate;
+        gate.targetQubit = op[0];
+        gate.controlOnes = static_cast<uint32_t>(op[2]);
+        gate.controlZeros = static_cast<uint32_t>(op[3]);
+        copy(gatePacks + 8*op[1], gatePacks + 8*op[1] + 8, gate.pack);
+        gate.kind = gateKinds[op[1]];
+        pushFusedGate(queue, gate);
+    }
+    flushFusedGates(state, queue, numQubits);
+}
+
+static vector<double> sweepValues;  // パラメータ掃引の入力値（reserveSweepValues で確保）
+static vector<double> sweepResults; // パラメータ掃引の密度行列（次の呼び出しまで有効）
+
+/**
+ * @brief パラメータ掃引の入力値の領域を確保する（JavaScript側から呼び出し）
+ *
+ * 呼び出し元は返された領域に値を書き込んでから sweepInitialParameter に渡します。
+ *
+ * @param count 値の数
+ * @return 入力値の領域（次の呼び出しまで有効）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE double* reserveSweepValues(int count){
+    sweepValues.assign(max(count, 1), 0.0);
+    return sweepValues.data();
+}
+
+/**
+ * @brief 2つの基底状態から量子ビットごとの A = Tr(ψ₀ψ₀†), B = Tr(ψ₁ψ₁†), C = Tr(ψ₀ψ₁†) を1回の走査で求める
+ *
+ * @param psi0 対象の量子ビットを |0⟩ とした最終状態（Real* またはSplitState）
+ * @param psi1 対象の量子ビットを |1⟩ とした最終状態（psi0 と同じ形式）
+ * @param numQubits 量子ビット数
+ * @param terms 量子ビットごとの [A, B, C]（各2×2、行優先、12要素×numQubits）
+ */
+template <typename State>
+void accumulateSweepTerms(State psi0, State psi1, int numQubits, vector<complex<double>>& terms){
+    vector<complex<double>> partial(static_cast<size_t>(MAX_THREADS) * 12 * numQubits); // スレッドごとの部分和
+    int usedThreads = parallelFor(1 << numQubits, [&](int t, int begin, int end){
+        complex<double>* sum = &partial[static_cast<size_t>(t) * 12 * numQubits];
+        for (int i = begin; i < end; ++i){
+            for (int k = 0; k < numQubits; ++k){
+                unsigned int kBit = 1u << (numQubits - k - 1);
+                if (i & kBit){
+                    continue;
+                }
+                complex<double> a[2] = {loadAmplitude(psi0, i), loadAmplitude(psi0, i | kBit)};
+                complex<double> b[2] = {loadAmplitude(psi1, i), loadAmplitude(psi1, i | kBit)};
+                complex<double>* s = sum + 12*k;
+                for (int x = 0; x < 2; ++x){
+                    for (int y = 0; y < 2; ++y){
+                        s[x*2+y] += a[x] * conj(a[y]);
+                        s[4 + x*2+y] += b[x] * conj(b[y]);
+                        s[8 + x*2+y] += a[x] * conj(b[y]);
+                    }
+                }
+            }
+        }
+    });
+    terms.assign(12 * static_cast<size_t>(numQubits), 0.0);
+    for (int t = 0; t < usedThreads; ++t){
+        for (size_t e = 0; e < terms.size(); ++e){
+            terms[e] += partial[static_cast<size_t>(t) * 12 * numQubits + e];
+        }
+    }
+}
+
+/**
+ * @brief 2つの基底状態を作成して回路を実行し、A, B, C を求める
+ *
+ * ψ₀ は呼び出し元の状態ベクトル領域（arenaの状態ベクトル）で計算し、ψ₁ の分だけ同じ精度・レイアウトの
+ * 作業領域を確保します。
+ *
+ * @return 作業領域を確保できた場合 true
+ */
+template <typename State>
+bool runSweepBasis(State psi0, const double* parameters, int numQubits, int qubit, const double* gatePacks,
+                   const int* gateKinds, const int* circuitOps, vector<complex<double>>& terms){
+    using Real = remove_pointer_t<decltype(stateData(psi0))>;
+    size_t amplitudes = static_cast<size_t>(1) << numQubits;
+    size_t bytes = (2 * amplitudes * sizeof(Real) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    unique_ptr<Real, decltype(&free)> work(static_cast<Real*>(aligned_alloc(ARENA_ALIGNMENT, bytes)), &free);
+    if (!work){
+        return false;
+    }
+    State psi1;
+    if constexpr (is_pointer<State>::value){
+        psi1 = work.get();
+    }else{
+        psi1 = State{work.get(), work.get() + amplitudes};
+    }
+
+    // 対象の量子ビットを |0⟩ とした初期状態の振幅を |…1_q…⟩ の位置に移して |1⟩ の初期状態を作成
+    double stateParams[4];
+    unsigned int bit = 1u << (numQubits - qubit - 1);
+    initialize(const_cast<double*>(parameters), numQubits, psi0, stateParams);
+    parallelFor(static_cast<int>(amplitudes), [&](int, int begin, int end){
+        for (int i = begin; i < end; ++i){
+            storeAmplitude(psi1, i, (i & bit) ? loadAmplitude(psi0, i ^ bit) : 0.0);
+        }
+    });
+    runCircuitOps(psi0, numQubits, gatePacks, gateKinds, circuitOps);
+    runCircuitOps(psi1, numQubits, gatePacks, gateKinds, circuitOps);
+    accumulateSweepTerms(psi0, psi1, numQubits, terms);
+    return true;
+}
+
+/**
+ * @brief 1つの初期状態パラメータ（スライダー）を複数の値に変えた密度行列をまとめて計算する
+ *
+ * 回路 U は線形なので、対象の量子ビット q の初期状態 α|0⟩ + β|1⟩ に対する最終状態は
+ * ψ = α·U|…0_q…⟩ + β·U|…1_q…⟩ です。2つの基底状態 ψ₀, ψ₁ だけ回路を実行し、
+ * 1回の走査で各量子ビットの A = Tr(ψ₀ψ₀†), B = Tr(ψ₁ψ₁†), C = Tr(ψ₀ψ₁†) を求めておけば、
+ * 各値の密度行列は ρ = |α|²A + αβ̄C + ᾱβC† + |β|²B として量子ビット数に比例する計算量で得られます。
+ * 回路の実行は値の数によらず2回です。ψ₀ には state（arenaの状態ベクトル）を使って上書きし、
+ * 追加で確保するのは同じ精度・レイアウトの状態ベクトル1本分です。
+ *
+ * @param floatArray 初期状態パラメータ配列 [θ₀, φ₀, θ₁, φ₁, ...]（度単位、掃引するパラメータ以外を使用）
+ * @param numQubits 量子ビット数
+ * @param circuitOps 回路の演算リスト（CIRCUIT_OP_SIZE 参照、全ての行を1回ずつ実行）
+ * @param parameterIndex 掃引するパラメータの floatArray 内の位置（2q = θ_q, 2q+1 = φ_q）
+ * @param values 掃引する値（度単位）
+ * @param valueCount 値の数
+ * @param state 作業に使う状態ベクトル（sumDoubleArray の initialstate と同じ領域、内容は上書き）
+ * @param flags 状態ベクトルの形式（sampleMeasurements と同じビット4 = 単精度、ビット5 = SoA）
+ * @return 値ごとの密度行列（calculateTraceState と同じ8要素×numQubits を valueCount 個、
+ *         次の呼び出しまで有効。parameterIndex が不正な場合・作業領域を確保できない場合は nullptr）
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE double* sweepInitialParameter(double* floatArray, int numQubits, const int* circuitOps, int parameterIndex,
+                                                               const double* values, int valueCount, double* state, int flags){
+    if (parameterIndex < 0 || parameterIndex >= 2*numQubits || valueCount <= 0 || !state){
+        return nullptr;
+    }
+    int qubit = parameterIndex / 2;
+    size_t amplitudes = static_cast<size_t>(1) << numQubits;
+
+    // 全ての回路を実行した後（θ = π）のゲート行列
+    double gatePacks[48];
+    int gates[6];
+    int gateKinds[6];
+    calculatGateState(M_PI, gatePacks, gates, gateKinds);
+
+    // 対象の量子ビットを |0⟩ / |1⟩ にした2つの初期状態から回路を実行
+    vector<double> parameters(floatArray, floatArray + 2*numQubits);
+    parameters[2*qubit] = 0.0;
+    parameters[2*qubit+1] = 0.0;
+    vector<complex<double>> terms;
+    bool singlePrecision = (flags & (1 << 4)) != 0;
+    bool splitLayout = (flags & (1 << 5)) != 0;
+    float* singleState = reinterpret_cast<float*>(state);
+    auto run = [&](auto psi0){
+        return runSweepBasis(psi0, parameters.data(), numQubits, qubit, gatePacks, gateKinds, circuitOps, terms);
+    };
+    bool computed;
+    if (splitLayout){
+        computed = singlePrecision ? run(SplitState<float>{singleState, singleState + amplitudes})
+                                   : run(SplitState<double>{state, state + amplitudes});
+    }else{
+        computed = singlePrecision ? run(singleState) : run(state);
+    }
+    if (!computed){
+        return nullptr;
+    }
+
+    // 値ごとに α, β を求めて密度行列を合成
+    double stateParams[4];
+    sweepResults.assign(static_cast<size_t>(valueCount) * 8 * numQubits, 0.0);
+    for (int v = 0; v < valueCount; ++v){
+        double theta = parameterIndex % 2 == 0 ? values[v] : floatArray[2*qubit];
+        double phi = parameterIndex % 2 == 0 ? floatArray[2*qubit+1] : values[v];
+        calculateQubitState(theta, phi, stateParams);
+        complex<double> alpha(stateParams[0], stateParams[1]);
+        complex<double> beta(stateParams[2], stateParams[3]);
+        double* out = &sweepResults[static_cast<size_t>(v) * 8 * numQubits];
+        for (int k = 0; k < numQubits; ++k){
+            const complex<double>* s = &terms[12*k];
+            for (int x = 0; x < 2; ++x){
+                for (int y = 0; y < 2; ++y){
+                    complex<double> rho = norm(alpha) * s[x*2+y] + norm(beta) * s[4 + x*2+y]
+                        + alpha * conj(beta) * s[8 + x*2+y] + conj(alpha) * beta * conj(s[8 + y*2+x]);
+                    out[8*k + 2*(x*2+y)] = rho.real();
+                    out[8*k + 2*(x*2+y) + 1] = (x == y) ? 0.0 : rho.imag(); // 対角要素の虚部は未使用
+                }
+            }
+        }
+    }
+    return sweepResults.data();
 }
\ No newline at end of file
@@ -24,7 +24,7 @@ import { draggingEvent } from './draggingItem.js';
 import { wasmStartAnimation } from './funcqcal.js';
 import { getStateFromSession, restoreGridState, saveStateToSession, getGateListFromSession, saveGateListToSession } from './stateData2.js';
 import { createProgressBar, createImportOption } from './createElement.js'
-import { getData } from './dataSend.js';
+import { getData, acceptResult } from './dataSend.js';
 import { toolbarLeftCanvas1 } from './toolbar.js'
 import { createGateElement } from './editGate.js'
 
@@ -92,10 +92,11 @@ export function drawCanvas1(canvas, container, state, shareState) {
             createProgressBar(container);
             const progressFill = document.getElementById('progress-fill');
             const progressBar = document.getElementById('progress-bar');
+            const acceptButton = document.getElementById('accept-result');
 
-            // サーバーからのプログレス更新を受信
+            // サーバーからのプログレス更新を受信（途中結果を採用した後は無視）
             socket.on('progress_update', (data) => {
-                if (data.page === 'index7') {
+                if (data.page === 'index7' && !share_state.searchAccepted) {
                     progressBar.style.display = 'block';
                     progressFill.style.display = 'block';
                     progressFill.style.width = data.progress + '%';
@@ -104,6 +105,20 @@ export function drawCanvas1(canvas, container, state, shareState) {
                         getData(canvas, container, state, shareState);
                     }                }
             });
+
+            // 途中結果（その時点で確定した最良の回路）を受信
+            socket.on('result_update', (data) => {
+                if (data.page === 'index7' && !share_state.searchAccepted) {
+                    share_state.searchResult = data.gate_array;
+                    acceptButton.title = `min diff: ${data.min_diff.toFixed(4)}`;
+                    acceptButton.style.display = 'block';
+                }
+            });
+
+            // 途中結果を採用して計算を停止
+            acceptButton.addEventListener('click', () => {
+                acceptResult(socket, canvas, container, state, shareState);
+            });
         }else{
             // 通常モードの場合はインポート機能を追加
             createImportOption(canvas, container, state, shareState);
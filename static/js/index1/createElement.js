@@ -126,6 +126,18 @@ export function createProgressBar(container) {
     progressBar.appendChild(progressFill);
     progressBar.style.transform = 'none !important';
 
+    // 途中結果の採用ボタン（サーバーから途中結果を受信すると表示）
+    const acceptButton = document.createElement('button');
+    acceptButton.id = 'accept-result';
+    acceptButton.textContent = '途中結果を採用';
+    acceptButton.style.position = 'absolute';
+    acceptButton.style.left = 'calc(100% + 10px)'; // プログレスバーの右側
+    acceptButton.style.top = '0';
+    acceptButton.style.height = '30px';
+    acceptButton.style.whiteSpace = 'nowrap';
+    acceptButton.style.display = 'none';
+    progressBar.appendChild(acceptButton);
+
     // 外側バーを親要素に追加
     parentElement.appendChild(progressBar);
 }
@@ -17,11 +17,57 @@
  * - プログレスバーの表示制御
  * - 非同期通信とエラーハンドリング
  * - グリッド状態の復元機能
+ * - 途中結果（Socket.IOで受信した最良の回路）の採用
  */
 
 import { restoreGridState } from './stateData2.js';
 import { drawCanvas1 } from './canvas1.js';
 
+// バイナリ形式の回路（gate_convert_2.encode_circuit_binary）の版番号とヘッダーのワード数
+const CIRCUIT_BINARY_VERSION = 2;
+const CIRCUIT_BINARY_HEADER = 3;
+
+// エンジンのゲートコード → 回路レイアウトの文字列（gate_convert_2.ENGINE_GATE_CODES の逆引き）
+const GATE_CODE_NAMES = {
+    120: 'X', 121: 'Y', 122: 'Z', 115: 'S', 116: 'T', 104: 'H',
+    99110: 'control', 99121: 'not-control'
+};
+
+/**
+ * バイナリ形式の回路を読み取る関数
+ * 
+ * ゲートコードは受信したバッファのビュー（コピーなし）で返します。
+ * 
+ * @param {ArrayBuffer} buffer - /get_result?format=binary のレスポンス
+ * @returns {Object} {numQubits, rows, cells: ゲートコード（行優先）}
+ */
+export function decodeCircuitBinary(buffer) {
+    const words = new Int32Array(buffer);
+    if (words[0] !== CIRCUIT_BINARY_VERSION) {
+        throw new Error(`Unsupported circuit format: ${words[0]}`);
+    }
+    const numQubits = words[1];
+    const rows = words[2];
+    return {
+        numQubits: numQubits,
+        rows: rows,
+        cells: words.subarray(CIRCUIT_BINARY_HEADER, CIRCUIT_BINARY_HEADER + rows * numQubits)
+    };
+}
+
+/**
+ * バイナリ形式の回路から回路レイアウト（repairGrid の入力）を作成する関数
+ * 
+ * @param {Object} circuit - decodeCircuitBinary の戻り値
+ * @returns {Array} 回路レイアウト [[キュービット0のゲート, キュービット1のゲート, ...], ...]
+ */
+function circuitLayout(circuit) {
+    return Array.from({ length: circuit.rows }, (_, i) =>
+        Array.from(circuit.cells.subarray(i * circuit.numQubits, (i + 1) * circuit.numQubits),
+                   (code) => GATE_CODE_NAMES[code] ?? '')
+    );
+}
+
 /**
  * データをサーバーに送信する関数
  * 
@@ -62,6 +108,11 @@ export function sendData(event, canvas, container, state, shareState, data) {
 
     const page = 'index7'
 
+    // 前回の途中結果をリセット
+    const share_state = shareState['canvas1'].share_state;
+    share_state.searchResult = null;
+    share_state.searchAccepted = false;
+
     const progressBar = document.getElementById('progress-bar');
     const progressFill = document.getElementById('progress-fill');
     progressFill.style.width = '0%';
@@ -78,6 +129,7 @@ export function sendData(event, canvas, container, state, shareState, data) {
     function progressExit(){
         progressBar.style.display = 'none';
         progressFill.style.display = 'none';
+        document.getElementById('accept-result').style.display = 'none';
     }
 
     // サーバーに計算リクエストを送信
@@ -132,11 +184,17 @@ export function getData(canvas, container, state, shareState) {
     function progressExit(){
         progressBar.style.display = 'none';
         progressFill.style.display = 'none';
+        document.getElementById('accept-result').style.display = 'none';
     }
 
-    // サーバーから結果データを取得
-    fetch('/get_result')
-    .then((response) => response.json())
+    // サーバーから結果データを取得（回路はバイナリ形式、エラーはJSONで返る）
+    fetch('/get_result?format=binary')
+    .then((response) => {
+        if (response.headers.get('Content-Type') === 'application/octet-stream') {
+            return response.arrayBuffer().then((buffer) => circuitLayout(decodeCircuitBinary(buffer)));
+        }
+        return response.json();
+    })
     .then((data) => {
         if (data.error) {
             progressExit()
@@ -146,9 +204,7 @@ export function getData(canvas, container, state, shareState) {
             });
         } else {
             // 取得したデータでグリッドを復元
-            const result = repairGrid(state, shareState, data)
-            restoreGridState(canvas, container, state, shareState, result);
-            drawCanvas1(canvas, container, state, shareState);
+            showCircuit(canvas, container, state, shareState, data);
             progressExit()
         }
     })
@@ -160,6 +216,49 @@ export function getData(canvas, container, state, shareState) {
 }
 
 
+/**
+ * 途中結果を採用する関数
+ * 
+ * Socket.IOで受信した最新の途中結果（その時点の最良の回路）でグリッドを復元し、
+ * サーバーに計算の停止を要求します。以降の進捗・途中結果の通知は無視します。
+ * 
+ * @param {Object} socket - Socket.IOクライアント
+ * @param {HTMLCanvasElement} canvas - 対象のキャンバス要素
+ * @param {HTMLElement} container - コンテナ要素
+ * @param {Object} state - アプリケーション状態
+ * @param {Object} shareState - 共有状態オブジェクト
+ */
+export function acceptResult(socket, canvas, container, state, shareState) {
+    const share_state = shareState['canvas1'].share_state;
+    if (!share_state.searchResult) {
+        return;
+    }
+    share_state.searchAccepted = true;
+    socket.emit('cancel_calculation'); // サーバー側の探索を停止
+
+    showCircuit(canvas, container, state, shareState, share_state.searchResult);
+    document.getElementById('progress-bar').style.display = 'none';
+    document.getElementById('progress-fill').style.display = 'none';
+    document.getElementById('accept-result').style.display = 'none';
+}
+
+
+/**
+ * サーバーから受信した回路でグリッドを復元して再描画する関数
+ * 
+ * @param {HTMLCanvasElement} canvas - 対象のキャンバス要素
+ * @param {HTMLElement} container - コンテナ要素
+ * @param {Object} state - アプリケーション状態
+ * @param {Object} shareState - 共有状態オブジェクト
+ * @param {Array} data - サーバーから受信した回路レイアウト
+ */
+function showCircuit(canvas, container, state, shareState, data) {
+    const result = repairGrid(state, shareState, data)
+    restoreGridState(canvas, container, state, shareState, result);
+    drawCanvas1(canvas, container, state, shareState);
+}
+
+
 /**
  * サーバーから受信したデータをグリッド形式に修復する関数
  * 
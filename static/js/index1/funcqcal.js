@@ -24,30 +24,59 @@ import { resizeChartCanvas } from './canvas3.js'
 // 計算結果の状態を格納するグローバルオブジェクト
 const resultState = {}
 
-/**
- * アラインメントを指定したバイト境界に揃える関数
- * @param {number} offset - 現在のオフセット値
- * @param {number} alignment - アラインメントするバイト数（通常8または16）
- * @returns {number} アラインメント済みのオフセット値
- */
-function alignTo(offset, alignment) {
-    return Math.ceil(offset / alignment) * alignment;
-}
+// ゲートIDから gatePacks 内のゲート番号への対応（qcal.cpp の calculatGateState と同じ並び）
+const GATE_INDEX = { 120: 0, 121: 1, 122: 2, 115: 3, 116: 4, 104: 5 };
+const CONTROL_CODE = 99110;     // コントロールビット用の特別なコード
+const NOT_CONTROL_CODE = 99121; // NOT-コントロールビット用の特別なコード
+const CIRCUIT_OP_SIZE = 4;      // 演算リストの1演算当たりの要素数（qcal.cpp と共通）
+
+// Workerとの制御ブロック（Int32Array）のワード位置（worker.js と共通）
+const CONTROL_COMMAND = 0;      // コマンドワード（WorkerがAtomics.waitで待機）
+const CONTROL_GENERATION = 1;   // 完了した計算の世代番号（Workerが計算ごとに加算）
+const CONTROL_OFFSETS = 2;      // sumDoubleArray の引数オフセット（16ワード）
+const CONTROL_LENGTH = CONTROL_OFFSETS + 16;
+const COMMAND_IDLE = 0;         // 待機中
+const COMMAND_RUN = 1;          // sumDoubleArray を1回実行
+const COMMAND_LAYOUT = 2;       // 引数オフセットのワードにバイト長を書き、layoutArena で領域を確保
+const COMMAND_SAMPLE = 3;       // 引数オフセットのワードの引数で sampleMeasurements を実行
+const COMMAND_PAIRS = 4;        // 引数オフセットのワードの引数で calculatePairMetrics を実行
+const COMMAND_SWEEP_VALUES = 5; // 引数オフセットの先頭のワードに値の数を書き、reserveSweepValues で入力値の領域を確保
+const COMMAND_SWEEP = 6;        // 引数オフセットのワードの引数で sweepInitialParameter を実行
+const MAX_METRIC_PAIRS = 6;     // 1回に計算できる量子ビット対の数（制御ブロックの残り12ワード）
+const PAIR_METRIC_SIZE = 34;    // 量子ビット対1件当たりの結果の要素数（qcal.cpp と共通）
+
+// WebAssembly SIMD128 対応判定用の最小モジュール
+// (func (result v128) i32.const 0 i8x16.splat i8x16.popcnt)
+const SIMD_PROBE = new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+]);
+
+// フェーズ別カウンタ（Float64Array）の並び（qcal.cpp の PhaseCounter と共通）
+const PHASE_COUNTER_NAMES = [
+    'sequence',      // 計測した呼び出しの通し番号
+    'totalMs',       // sumDoubleArray 全体の時間
+    'initializeMs',  // 初期状態の構築時間
+    'circuitMs',     // 演算リストの処理時間（ゲート適用を除く）
+    'gateMs',        // ゲート適用の時間
+    'traceMs',       // 密度行列計算の時間
+    'sweeps',        // 状態ベクトルの走査回数
+    'pairs',         // 更新した振幅ペア数
+    'swaps'          // 量子ビット交換の回数
+];
 
 /**
  * WASMでの量子計算のためのデータ準備と実行関数
  * 
  * 量子回路グリッドからゲートデータを抽出し、WASMが理解できる数値形式に変換して
- * 共有メモリに配置し、計算の準備を行います。
+ * エンジンが確保した共有メモリ上の領域に配置し、計算の準備を行います。
  * 
  * @param {Object} state - 量子回路の状態情報（グリッドデータなど）
  * @param {Object} shareState - 共有状態オブジェクト
- * @param {SharedArrayBuffer} sharedBuffer - WASM計算用の共有メモリバッファ
- * @param {Array} constOffsets - メモリオフセット配列
- * @param {number} constOffset - 基準オフセット値
- * @returns {Array} 更新されたオフセット配列
+ * @param {WebAssembly.Memory} memory - WASM計算用の共有メモリ
+ * @param {Function} requestLayout - 領域のバイト長を渡し、エンジンが返す先頭オフセットを受け取る関数
+ * @returns {Promise<Array|null>} sumDoubleArray の引数オフセット配列（確保できない場合はnull）
  */
-function loadAndRunWasm(state, shareState, sharedBuffer, constOffsets, constOffset) {
+async function loadAndRunWasm(state, shareState, memory, requestLayout) {
 
     let numGates = 0; // 回路内のゲート数をカウント
       /**
@@ -64,9 +93,9 @@ function loadAndRunWasm(state, shareState, sharedBuffer, constOffsets, constOffs
                 countChar = char.charCodeAt() // 単文字ゲートはASCIIコード
                 numGates++; // ゲート数の記録用
             }else if(char === 'control'){
-                countChar  = 99110; // コントロールビット用の特別なコード
+                countChar  = CONTROL_CODE;
             }else if(char === 'not-control'){
-                countChar  = 99121; // NOT-コントロールビット用の特別なコード
+                countChar  = NOT_CONTROL_CODE;
             }
         }
         return countChar;
@@ -164,6 +193,44 @@ function loadAndRunWasm(state, shareState, sharedBuffer, constOffsets, constOffs
         }        return gateData;
     }
 
+    /**
+     * 数値化した回路データから演算リストを生成する関数
+     * 各行（列方向の1ステップ）のターゲットゲートごとに
+     * [ターゲットビット, ゲート番号, 制御マスク, NOT-制御マスク] を並べ、
+     * WASM側で行ごとの解析をせずにそのまま実行できる形式にします
+     * 
+     * @param {Array} circuitData - 数値化した回路データ（行数 × キュービット数を平坦化）
+     * @param {number} numQubits - キュービット数
+     * @returns {Int32Array} 演算リスト [行数R, 各行の先頭演算番号 ×(R+1), 演算 ×演算数]
+     */
+    function generateCircuitOps(circuitData, numQubits) {
+        const rows = circuitData.length / numQubits;
+        const rowStart = [0];
+        const ops = [];
+        for (let i = 0; i < rows; i++){
+            const row = circuitData.slice(i * numQubits, (i + 1) * numQubits);
+            // 同じ行のゲートは全て同じ制御ビットを持つ
+            let controlOnes = 0;
+            let controlZeros = 0;
+            row.forEach((code, q) => {
+                if (code === CONTROL_CODE){
+                    controlOnes |= 1 << q;
+                }else if (code === NOT_CONTROL_CODE){
+                    controlZeros |= 1 << q;
+                }
+            });
+            // ターゲットゲートはキュービット番号の降順に配置
+            for (let q = numQubits - 1; q >= 0; q--){
+                const code = row[q];
+                if (code !== 0 && code !== CONTROL_CODE && code !== NOT_CONTROL_CODE){
+                    ops.push(q, GATE_INDEX[code] ?? 0, controlOnes, controlZeros);
+                }
+            }
+            rowStart.push(ops.length / CIRCUIT_OP_SIZE);
+        }
+        return Int32Array.from([rows, ...rowStart, ...ops]);
+    }
+
     /**
      * スライダーの初期値を取得する関数
      * ThetaとPhiパラメータの値をキュービットごとに収集します
@@ -201,43 +268,27 @@ function loadAndRunWasm(state, shareState, sharedBuffer, constOffsets, constOffs
 
     const gateCicuitData = flattenedData.map(charToNumber); // 文字を数字に変換
 
-    const SliderData = initialSliderValue(); // スライダーデータの取得    // 必要なサイズを計算（実際にはarrayLengthや要素数に応じて柔軟に）
-    const lengthint = gateCicuitData.length;
-
-    // 各データ型のバイト長を計算
-    const gateByteLength = gateCicuitData.length * Int32Array.BYTES_PER_ELEMENT;
-    const lengthintByteLength = Int32Array.BYTES_PER_ELEMENT;
-
-    // メモリ上の配置(オフセット)を決める - 16バイトアラインメントで配置
-    let offset = constOffset;
-
-    const gateOffset = offset;
-    offset += alignTo(gateByteLength, 16);
-
-    const lengthintOffset = offset;
-    offset += alignTo(lengthintByteLength, 16);
+    const circuitOps = generateCircuitOps(gateCicuitData, numQubits); // 演算リストの生成
 
-    // WASMメモリページサイズ計算
-    const pageSize = 65536; // 1ページ = 64KiB
-    const neededPages = Math.ceil(offset / pageSize);
-
-    const initial = neededPages;  // 必要分ちょうど
-    const maximum = initial + 64; // 256ページ(約16MB)など、任意の上限
-
-    // TypedArrayの作成 - 共有メモリ上にデータビューを作成
-    const gateView = new Int32Array(sharedBuffer, gateOffset, gateCicuitData.length);
-    const lengthintView = new Int32Array(sharedBuffer, lengthintOffset, 1);
+    const SliderData = initialSliderValue(); // スライダーデータの取得
+    const lengthint = gateCicuitData.length;
 
-    // 結果状態に共有ビューを保存
-    resultState.shared.gateView = gateView;
-    resultState.shared.lengthintView = lengthintView;
+    // 回路の大きさに合わせてエンジンに領域を確保させ、返されたオフセットからビューを作り直す
+    // （メモリが拡張されると以前のビューは新しい領域を参照できないため、毎回 memory.buffer から作成）
+    const offsets = await requestLayout(arenaByteLengths(numQubits, resultState.shared.singlePrecision, lengthint, circuitOps.length));
+    if (offsets.includes(0)) {
+        return null;
+    }
+    createSharedViews(memory.buffer, offsets, numQubits, lengthint, circuitOps.length);
 
     // データ書き込み（初期値設定) - 計算用データをメモリに配置
     resultState.shared.sliderView.set(SliderData);
     resultState.shared.gateView.set(gateCicuitData);
     resultState.shared.lengthintView[0] = lengthint;
+    resultState.shared.circuitOpsView.set(circuitOps);
     resultState.shared.numQubitsView[0] = numQubits;
     resultState.shared.progressView[0] = 0;
+    resultState.shared.timeBudgetView[0] = shareState['canvas1'].share_state.timeBudget ?? 0; // 1回の呼び出しの時間予算（ミリ秒）
     
     // 計算カテゴリに応じた設定
     if (shareState['canvas1'].share_state.calcCategory == 'normal'){
@@ -247,145 +298,112 @@ function loadAndRunWasm(state, shareState, sharedBuffer, constOffsets, constOffs
         resultState.shared.cutintView[0] = shareState['canvas1'].share_state.cutintValue; // カット値
         resultState.shared.boolView[0] = BigInt(6);   // 計算モードフラグ
     }
-
-    // オフセット情報を更新
-    constOffsets[1] = gateOffset;
-    constOffsets[2] = lengthintOffset;
+    if (resultState.shared.singlePrecision){
+        resultState.shared.boolView[0] |= BigInt(16); // 単精度モードフラグ（ビット4）
+    }
+    if (resultState.shared.splitLayout){
+        resultState.shared.boolView[0] |= BigInt(32); // SoAレイアウトフラグ（ビット5）
+    }
+    if (resultState.shared.clusterMode){
+        resultState.shared.boolView[0] |= BigInt(64); // クラスタモードフラグ（ビット6）
+    }
 
     console.log("ゲート数:",numGates) // デバッグ用：ゲート数出力
 
-    return constOffsets;
+    return offsets;
 }
 
 /**
  * WASM計算用の初期メモリ設定を行う関数
  * 
- * 量子計算に必要な全ての配列（状態ベクトル、密度行列、パラメータなど）の
- * メモリ領域を共有バッファ上に確保し、TypedArrayビューを作成します。
+ * エンジンの静的領域にある制御ブロックとフェーズ別カウンタのビューを作成し、
+ * セッション単位の設定とともに保持します。計算用の配列は計算ごとに createSharedViews で作成します。
  * 
- * @param {number} maxQubits - 最大キュービット数
  * @param {SharedArrayBuffer} sharedBuffer - 共有メモリバッファ
- * @returns {Object} オフセット配列と最終オフセット値を含むオブジェクト
+ * @param {number} controlOffset - 制御ブロックのバイトオフセット（workerControlBlock）
+ * @param {number} countersOffset - フェーズ別カウンタのバイトオフセット（phaseCounterBlock）
+ * @param {boolean} singlePrecision - 状態ベクトルをFloat32で保持する場合はtrue
+ * @param {boolean} splitLayout - 状態ベクトルを実部配列・虚部配列に分けて保持する場合はtrue
+ * @param {boolean} clusterMode - エンタングルした量子ビットの組ごとに状態を保持する場合はtrue
  */
-function initialWasmSetting(maxQubits, sharedBuffer){    // 必要なサイズを計算（実際にはarrayLengthや要素数に応じて柔軟に）
-    // 各配列の要素数を計算
-    const progressArrayLength = 1;                      // 進捗カウンター
-    const boolArrayLength = 1;                         // ブール値フラグ
-    const arrayLength = maxQubits * 9;                 // 結果配列
-    const SliderDataLength = maxQubits*2;              // スライダーデータ（Theta,Phi）
-    const stateLength = 2*(1 << maxQubits);            // 量子状態ベクトル（複素数）
-    const stateParamsLength = 4;                       // 状態パラメータ
-    const ControlStateLength = (1 << (maxQubits-1))/64; // コントロール状態
-    const gatePacksLength = 6*2*2*2;                   // ゲートパック
-    const gatesLength = 6;                             // ゲート配列
-    const newCircuitLength = maxQubits*maxQubits;      // 新しい回路データ
-    const densityMatrixLength = 8*maxQubits;           // 密度行列
-    const ncgateLength = 3;                            // NCゲート
-
-    // 各配列のバイト長を計算
-    const resultByteLength = arrayLength * Float64Array.BYTES_PER_ELEMENT; 
-    const stateByteLength = stateLength * Float64Array.BYTES_PER_ELEMENT; 
-    const progressByteLength = progressArrayLength * Int32Array.BYTES_PER_ELEMENT;
-    const boolByteLength = boolArrayLength * BigUint64Array.BYTES_PER_ELEMENT;    const sliderByteLength = SliderDataLength * Float64Array.BYTES_PER_ELEMENT;
-    const stateParamsByteLength = stateParamsLength * Float64Array.BYTES_PER_ELEMENT;
-    const ControlStateByteLength = ControlStateLength * BigUint64Array.BYTES_PER_ELEMENT;
-    const gatePacksByteLength = gatePacksLength * Float64Array.BYTES_PER_ELEMENT;
-    const gatesByteLength = gatesLength * Int32Array.BYTES_PER_ELEMENT;
-    const ncgateByteLength = ncgateLength * Int32Array.BYTES_PER_ELEMENT;
-    const newCircuitByteLength = newCircuitLength * Int32Array.BYTES_PER_ELEMENT;
-    const densityMatrixByteLength = densityMatrixLength * Float64Array.BYTES_PER_ELEMENT;
-    const numQubitsByteLength = Int32Array.BYTES_PER_ELEMENT;
-    const cutintByteLength = Int32Array.BYTES_PER_ELEMENT;
-
-    // メモリ上の配置(オフセット)を決める - 16バイトアラインメントで最適化
-    let offset = 0;
-    const sliderOffset = offset; 
-    offset += alignTo(sliderByteLength, 16);
-    const numQubitsOffset = offset;
-    offset += alignTo(numQubitsByteLength, 16);
-    const cutintOffset = offset;
-    offset += alignTo(cutintByteLength, 16);
-    const resultOffset = offset;
-    offset += alignTo(resultByteLength, 16);
-    const progressOffset = offset;
-    offset += alignTo(progressByteLength, 16);
-    const boolOffset = offset;
-    offset += alignTo(boolByteLength, 16);
-    const stateOffset = offset;
-    offset += alignTo(stateByteLength, 16);
-    const stateParamsOffset = offset;
-    offset += alignTo(stateParamsByteLength, 16);
-    const ControlStateOffset = offset;
-    offset += alignTo(ControlStateByteLength, 16);
-    const gatePacksOffset = offset;
-    offset += alignTo(gatePacksByteLength, 16);
-    const gatesOffset = offset;
-    offset += alignTo(gatesByteLength, 16);
-    const newCicuiteOffset = offset;
-    offset += alignTo(newCircuitByteLength, 16);
-    const densityMatrixOffset = offset;
-    offset += alignTo(densityMatrixByteLength, 16);
-    const ncgateOffset = offset;
-    offset += alignTo(ncgateByteLength, 16);
-
-    // WASMメモリページサイズ計算
-    const pageSize = 65536; // 1ページ = 64KiB
-    const neededPages = Math.ceil(offset / pageSize);
-
-    const initial = neededPages;  // 必要分ちょうど
-    const maximum = initial + 64; // 256ページ(約16MB)など、任意の上限
-
-    // TypedArrayの作成 - 各データ型に応じた共有メモリビューを作成
-    const sliderView = new Float64Array(sharedBuffer, sliderOffset, SliderDataLength);
-    const numQubitsView = new Int32Array(sharedBuffer, numQubitsOffset, 1);
-    const cutintView = new Int32Array(sharedBuffer, cutintOffset, 1);
-    const resultView = new Float64Array(sharedBuffer, resultOffset, arrayLength);
-    const stateView = new Float64Array(sharedBuffer, stateOffset, stateLength);
-    const stateParamsView = new Float64Array(sharedBuffer, stateParamsOffset, stateParamsLength);
-    const ControlState = new BigUint64Array(sharedBuffer, ControlStateOffset, ControlStateLength);
-    const gatePacksView = new Float64Array(sharedBuffer, gatePacksOffset, gatePacksLength);
-    const gatesView = new Int32Array(sharedBuffer, gatesOffset, gatesLength);
-    const ncgateView = new Int32Array(sharedBuffer, ncgateOffset, ncgateLength);
-    const newCircuitView = new Int32Array(sharedBuffer, newCicuiteOffset, newCircuitLength);
-    const densityMatrixView = new Float64Array(sharedBuffer, densityMatrixOffset, densityMatrixLength);
-    const progressView = new Int32Array(sharedBuffer, progressOffset, 1);
-    const boolView = new BigUint64Array(sharedBuffer, boolOffset, 1);
-
-    // グローバル結果状態オブジェクトに共有ビューを格納
+function initialWasmSetting(sharedBuffer, controlOffset, countersOffset, singlePrecision, splitLayout, clusterMode){
     resultState.shared = {
-        resultView: resultView,
-        progressView: progressView,
-        boolView: boolView,
-        stateView: stateView,
-        numQubitsView: numQubitsView,
-        sliderView: sliderView,
-        cutintView: cutintView,
-        ncgateView: ncgateView,
-        densityMatrixView: densityMatrixView
+        singlePrecision: singlePrecision,
+        splitLayout: splitLayout,
+        clusterMode: clusterMode,
+        controlView: new Int32Array(sharedBuffer, controlOffset, CONTROL_LENGTH),
+        countersView: new Float64Array(sharedBuffer, countersOffset, PHASE_COUNTER_NAMES.length)
     }
+}
+
+/**
+ * sumDoubleArray の引数ごとの領域のバイト長を計算する関数
+ * 並びは制御ブロックの引数オフセット（0〜15）と同じです。
+ * 
+ * @param {number} numQubits - キュービット数
+ * @param {boolean} singlePrecision - 状態ベクトルをFloat32で保持する場合はtrue
+ * @param {number} circuitLength - 回路データの要素数
+ * @param {number} circuitOpsLength - 演算リストの要素数
+ * @returns {Array} 各領域のバイト長
+ */
+function arenaByteLengths(numQubits, singlePrecision, circuitLength, circuitOpsLength){
+    const StateArray = singlePrecision ? Float32Array : Float64Array; // 状態ベクトルの要素型
+    return [
+        numQubits * 2 * Float64Array.BYTES_PER_ELEMENT,               // 0: スライダーデータ（Theta,Phi）
+        circuitLength * Int32Array.BYTES_PER_ELEMENT,                 // 1: ゲートデータ
+        Int32Array.BYTES_PER_ELEMENT,                                 // 2: 長さデータ
+        Int32Array.BYTES_PER_ELEMENT,                                 // 3: キュービット数
+        Int32Array.BYTES_PER_ELEMENT,                                 // 4: カット値
+        numQubits * 9 * Float64Array.BYTES_PER_ELEMENT,               // 5: 結果データ
+        Int32Array.BYTES_PER_ELEMENT,                                 // 6: 進捗
+        BigUint64Array.BYTES_PER_ELEMENT,                             // 7: ブール値
+        2 * (1 << numQubits) * StateArray.BYTES_PER_ELEMENT,          // 8: 状態ベクトル（複素数）
+        4 * Float64Array.BYTES_PER_ELEMENT,                           // 9: 状態パラメータ
+        6 * 2 * 2 * 2 * Float64Array.BYTES_PER_ELEMENT,               // 10: ゲートパック
+        6 * Int32Array.BYTES_PER_ELEMENT,                             // 11: ゲート配列
+        circuitOpsLength * Int32Array.BYTES_PER_ELEMENT,              // 12: 演算リスト
+        8 * numQubits * Float64Array.BYTES_PER_ELEMENT,               // 13: 密度行列
+        6 * Int32Array.BYTES_PER_ELEMENT,                             // 14: ゲート種類（対角・反対角・一般）
+        Float64Array.BYTES_PER_ELEMENT                                // 15: 時間予算（ミリ秒）
+    ];
+}
+
+/**
+ * エンジンが返したオフセットから計算用のTypedArrayビューを作成する関数
+ * 
+ * @param {SharedArrayBuffer} sharedBuffer - 現在の共有メモリバッファ（memory.buffer）
+ * @param {Array} offsets - 各領域の先頭オフセット（arenaByteLengths と同じ並び）
+ * @param {number} numQubits - キュービット数
+ * @param {number} circuitLength - 回路データの要素数
+ * @param {number} circuitOpsLength - 演算リストの要素数
+ */
+function createSharedViews(sharedBuffer, offsets, numQubits, circuitLength, circuitOpsLength){
+    const StateArray = resultState.shared.singlePrecision ? Float32Array : Float64Array;
+    Object.assign(resultState.shared, {
+        sliderView: new Float64Array(sharedBuffer, offsets[0], numQubits * 2),
+        gateView: new Int32Array(sharedBuffer, offsets[1], circuitLength),
+        lengthintView: new Int32Array(sharedBuffer, offsets[2], 1),
+        numQubitsView: new Int32Array(sharedBuffer, offsets[3], 1),
+        cutintView: new Int32Array(sharedBuffer, offsets[4], 1),
+        resultView: new Float64Array(sharedBuffer, offsets[5], numQubits * 9),
+        progressView: new Int32Array(sharedBuffer, offsets[6], 1),
+        boolView: new BigUint64Array(sharedBuffer, offsets[7], 1),
+        stateView: new StateArray(sharedBuffer, offsets[8], 2 * (1 << numQubits)),
+        circuitOpsView: new Int32Array(sharedBuffer, offsets[12], circuitOpsLength),
+        densityMatrixView: new Float64Array(sharedBuffer, offsets[13], 8 * numQubits),
+        timeBudgetView: new Float64Array(sharedBuffer, offsets[15], 1)
+    });
+}
 
-    // NCゲートの初期値設定
-    resultState.shared.ncgateView[0] = 0;      // 通常
-    resultState.shared.ncgateView[1] = 99110;  // コントロール
-    resultState.shared.ncgateView[2] = 99121;  // NOT-コントロール    // 配列にオフセットを準備 - WASM関数に渡すためのオフセット配列
-    const offsets = [
-        sliderOffset,      // 0: スライダーデータ
-        0,                 // 1: ゲートデータ（後で設定）
-        0,                 // 2: 長さデータ（後で設定）
-        numQubitsOffset,   // 3: キュービット数
-        cutintOffset,      // 4: カット値
-        resultOffset,      // 5: 結果データ
-        progressOffset,    // 6: 進捗
-        boolOffset,        // 7: ブール値
-        stateOffset,       // 8: 状態ベクトル
-        stateParamsOffset, // 9: 状態パラメータ
-        ControlStateOffset,// 10: コントロール状態
-        gatePacksOffset,   // 11: ゲートパック
-        gatesOffset,       // 12: ゲート配列
-        newCicuiteOffset,  // 13: 新回路
-        densityMatrixOffset,// 14: 密度行列
-        ncgateOffset       // 15: NCゲート
-    ];    return {constOffsets: offsets, constOffset: offset};
+/**
+ * フェーズ別カウンタの読み取り
+ * share_state.counters が有効な場合に、直前の sumDoubleArray 呼び出しの計測値を返します
+ *
+ * @returns {Object} カウンタ名をキーとする計測値（時間はミリ秒）
+ */
+export function readPhaseCounters() {
+    const view = resultState.shared.countersView;
+    return Object.fromEntries(PHASE_COUNTER_NAMES.map((name, index) => [name, view[index]]));
 }
 
 /**
@@ -427,8 +445,8 @@ function returnResult(state, shareState){    var rows = state.grid[0].length; //
     const densityMatrix = JSON.parse(JSON.stringify(densityMatrixOrigin));
 
     // 結果の配列データをJavaScript側にコピー
-    // 8キュービット以下の場合のみチャート表示
-    if(rows<=8){        if (shareState['canvas3']){
+    // 8キュービット以下の場合のみチャート表示（測定サンプリング時は showShotHistogram で表示）
+    if(rows<=8 && !(shareState['canvas1'].share_state.shots > 0)){        if (shareState['canvas3']){
             const quantumChart = shareState['canvas3'].share_state.quantumChart;
             const totalElements = 2 ** rows; // 2^n個の状態
     
@@ -436,9 +454,14 @@ function returnResult(state, shareState){    var rows = state.grid[0].length; //
             const newData = [];
             const newLabels = [];
     
+            // SoAレイアウトでは前半が実部・後半が虚部
+            const stateView = resultState.shared.stateView;
+            const split = resultState.shared.splitLayout;
             for (let i = 0; i < totalElements; i++) {
                 // 振幅を計算してデータセットに追加（確率 = |amplitude|^2）
-                newData.push((resultState.shared.stateView[2*i] ** 2 + resultState.shared.stateView[2*i+1] ** 2));
+                const re = split ? stateView[i] : stateView[2*i];
+                const im = split ? stateView[totalElements+i] : stateView[2*i+1];
+                newData.push(re ** 2 + im ** 2);
     
                 // ラベルを生成（二進数表現）
                 newLabels.push(i.toString(2).padStart(rows, '0'));
@@ -539,6 +562,107 @@ function returnResult(state, shareState){    var rows = state.grid[0].length; //
     }
 }
 
+/**
+ * 測定サンプリングの結果をヒストグラムとしてチャートに反映する関数
+ * 
+ * 1回以上現れた結果だけを表示するため、20キュービット程度でも状態ベクトルを読み出さずに描画できます。
+ * 
+ * @param {Int32Array} counts - 結果ごとの回数（sampleMeasurements の戻り値）
+ * @param {number} measured - 測定したキュービット数（ラベルの桁数）
+ * @param {number} shots - 測定回数
+ * @param {Object} shareState - 共有状態オブジェクト
+ */
+function showShotHistogram(counts, measured, shots, shareState){
+    if (!shareState['canvas3']){
+        return;
+    }
+    const quantumChart = shareState['canvas3'].share_state.quantumChart;
+    const newData = [];
+    const newLabels = [];
+    counts.forEach((count, outcome) => {
+        if (count > 0){
+            newData.push(count / shots); // 相対頻度
+            newLabels.push(outcome.toString(2).padStart(measured, '0'));
+        }
+    });
+
+    // 表示する結果の数が変わった場合のみリサイズ
+    const resize = quantumChart.data.datasets[0].data.length !== newData.length;
+    quantumChart.data.datasets[0].data = newData;
+    quantumChart.data.labels = newLabels;
+    if (resize){
+        resizeChartCanvas(quantumChart, shareState);
+    }else{
+        quantumChart.update();
+    }
+}
+
+/**
+ * WASMファイルを取得してコンパイルする関数
+ * 
+ * コンパイルはダウンロードと並行して行い（compileStreaming）、
+ * 使えない場合（MIMEタイプが異なる場合など）は取得後にコンパイルします。
+ * 
+ * @param {string} url - WASMファイルのURL
+ * @returns {Promise<WebAssembly.Module>} コンパイル済みのモジュール（取得に失敗した場合は例外）
+ */
+async function compileWasm(url) {
+    if (WebAssembly.compileStreaming) {
+        try {
+            return await WebAssembly.compileStreaming(fetch(url));
+        } catch (error) {
+            console.error('Streaming compilation failed:', error);
+        }
+    }
+    const response = await fetch(url);
+    if (!response.ok) {
+        throw new Error('Failed to fetch ' + url + ': ' + response.status);
+    }
+    return await WebAssembly.compile(await response.arrayBuffer());
+}
+
+/**
+ * 計算エンジン（WebAssemblyモジュール）を取得してコンパイルする関数
+ * 
+ * SIMD対応ブラウザでは -msimd128 でビルドしたエンジンを選びます。
+ * SIMD128版がビルドされていない（/engine_manifest にハッシュがない）場合や
+ * 取得・コンパイルに失敗した場合は通常版を使用します。
+ * URLにはサーバーが返す内容のハッシュを付けるため、
+ * 同じ内容のエンジンはHTTPキャッシュ（immutable）から読み込まれます。
+ * コンパイル済みのモジュールをWorkerに渡して再コンパイルを避けます。
+ * 
+ * @returns {Promise<Object>} {script: グルーコードのURL, module: コンパイル済みの WebAssembly.Module}
+ */
+async function compileEngine() {
+    let hashes = null;
+    try {
+        const response = await fetch('/engine_manifest', { cache: 'no-cache' });
+        hashes = await response.json();
+    } catch (error) {
+        console.error('Failed to load the engine manifest:', error); // ハッシュなしのURLで読み込む
+    }
+    const versioned = (file) => '/static/cpp/' + file + (hashes && hashes[file] ? '?v=' + hashes[file] : '');
+
+    // 候補のエンジン（マニフェストを取得できなかった場合はSIMD128版も試す）
+    const names = ['qcal'];
+    const simdBuilt = !hashes || (hashes['qcal-simd.wasm'] && hashes['qcal-simd.js']);
+    if (WebAssembly.validate(SIMD_PROBE) && simdBuilt) {
+        names.unshift('qcal-simd');
+    }
+
+    for (const name of names) {
+        try {
+            const module = await compileWasm(versioned(name + '.wasm'));
+            return { script: versioned(name + '.js'), module: module };
+        } catch (error) {
+            if (name === names[names.length - 1]) {
+                throw error;
+            }
+            console.error('Falling back to the scalar engine:', error);
+        }
+    }
+}
+
 /**
  * WASM計算のアニメーションループを開始する非同期関数
  * 
@@ -552,22 +676,25 @@ export async function wasmStartAnimation(state, shareState) {    let share_state
     let isProcessingWasm = false;  // WASM 処理中かどうかを判定するフラグ
     
     // WASMメモリとWorkerの初期化設定
-    const pageSize = 65536; // 1ページ = 64KiB
-    const maxQubits = 21;   // 最大キュービット数
-    const memory = new WebAssembly.Memory({ initial: 2048, maximum: 2048, shared: true });
-    const sharedBuffer = memory.buffer; // SharedArrayBuffer
+    // 初期サイズは16MB（em++ の INITIAL_MEMORY と同じ）で、計算領域・チェックポイントに合わせてエンジンが拡張
+    // 上限128MB（2048ページ）は最大21キュービットの状態ベクトルとチェックポイントを収める大きさ
+    // （スライダーの掃引は状態ベクトル1本分を追加で確保し、確保できない場合は掃引のみ失敗）
+    const memory = new WebAssembly.Memory({ initial: 256, maximum: 2048, shared: true });
     
-    // Web Worker の初期化
+    // Web Worker の初期化（エンジンのコンパイルと並行してWorkerを起動）
     const worker = new Worker('/static/js/index1/worker.js');
     let workerFinished = false
+    let blockOffsets = null; // エンジンの静的領域にある制御ブロック・カウンタのオフセット
+    const engine = await compileEngine();
     
-    // Worker初期化メッセージ送信
-    worker.postMessage({types: 'initialize', sharedBuffer: sharedBuffer, memory: memory, offsets: null});
+    // Worker初期化メッセージ送信（コンパイル済みのモジュールを渡す）
+    worker.postMessage({types: 'initialize', sharedBuffer: memory.buffer, memory: memory, offsets: null, engine: engine});
     
     // Web Worker から計算結果を受け取る
     worker.onmessage = function (event) {
         if (event.data.success) {
             workerFinished = true;
+            blockOffsets = event.data.offsets;
             console.log('WASM calculation completed successfully.');
         } else {
             console.error('Error in WASM calculation:', event.data.error);
@@ -580,59 +707,241 @@ export async function wasmStartAnimation(state, shareState) {    let share_state
     }
 
     // WASM用メモリ領域の初期設定
-    const {constOffsets, constOffset} = initialWasmSetting(maxQubits, sharedBuffer);    /**
+    const singlePrecision = share_state.precision === 'single'; // セッション単位で精度を選択
+    const splitLayout = share_state.layout === 'split';          // セッション単位でレイアウトを選択
+    const clusterMode = share_state.stateMode === 'cluster';     // 未エンタングルの量子ビットを個別に保持
+    initialWasmSetting(memory.buffer, blockOffsets.control, blockOffsets.counters, singlePrecision, splitLayout, clusterMode);
+
+    // Workerを常駐計算ループに切り替え（以降の計算要求・完了通知は制御ブロック経由）
+    // フェーズ別カウンタは share_state.counters が有効な場合のみエンジンに渡す（0 で計測なし）
+    const control = resultState.shared.controlView;
+    const countersOffset = share_state.counters ? resultState.shared.countersView.byteOffset : 0;
+    worker.postMessage({types: 'listen', sharedBuffer: memory.buffer, memory: null, offsets: [control.byteOffset, countersOffset]});
+    worker.onmessage = function (event) {
+        if (!event.data.success) {
+            console.error('Error in WASM calculation:', event.data.error);
+        }
+    };
+
+    let generation = Atomics.load(control, CONTROL_GENERATION); // 最後に反映した計算の世代番号
+    let offsets = null;      // 実行中の計算の引数オフセット（領域の確保中はnull）
+    let startTime = 0;       // 計算ステップの開始時刻
+    let nextStepTime = null; // 次の計算ステップの開始予定時刻（継続計算中のみ）
+
+    /**
+     * 制御ブロックに引数を書き込み、Workerに計算ステップの実行を指示する
+     */
+    function invokeWorker() {
+        startTime = performance.now();
+        control.set(offsets, CONTROL_OFFSETS);
+        Atomics.store(control, CONTROL_COMMAND, COMMAND_RUN);
+        Atomics.notify(control, CONTROL_COMMAND);
+    }
+
+    /**
+     * 制御ブロックに引数を書き込み、Workerに補助コマンドを実行させて完了を待つ
+     * 
+     * @param {number} command - コマンド（COMMAND_LAYOUT / COMMAND_SAMPLE など）
+     * @param {Array} words - 引数オフセットのワードに書き込む値
+     * @returns {Promise<Array>} 実行後の引数オフセットのワード（コマンドの戻り値）
+     */
+    async function requestCommand(command, words) {
+        const expected = Atomics.load(control, CONTROL_GENERATION);
+        control.set(words, CONTROL_OFFSETS);
+        Atomics.store(control, CONTROL_COMMAND, command);
+        Atomics.notify(control, CONTROL_COMMAND);
+
+        // 世代番号の更新まで待機（メインスレッドでは Atomics.wait を使えないため非同期に待つ）
+        while (Atomics.load(control, CONTROL_GENERATION) === expected) {
+            if (Atomics.waitAsync) {
+                await Atomics.waitAsync(control, CONTROL_GENERATION, expected).value;
+            } else {
+                await new Promise(resolve => setTimeout(resolve, 1));
+            }
+        }
+        generation = Atomics.load(control, CONTROL_GENERATION); // 補助コマンドの完了は計算結果として扱わない
+        return Array.from(control.subarray(CONTROL_OFFSETS, CONTROL_LENGTH));
+    }
+
+    /**
+     * Workerにアリーナの確保を指示する
+     * 
+     * @param {Array} byteLengths - 各領域のバイト長（arenaByteLengths）
+     * @returns {Promise<Array>} 各領域の先頭オフセット（確保できない場合は0を含む）
+     */
+    function requestLayout(byteLengths) {
+        return requestCommand(COMMAND_LAYOUT, byteLengths);
+    }
+
+    /**
+     * 計算済みの状態ベクトルから測定結果をサンプリングし、ヒストグラムを表示する
+     * 
+     * 測定するキュービットは share_state.shotQubits（未指定の場合は全キュービット）です。
+     * 
+     * @param {number} stateOffset - 状態ベクトルのオフセット
+     */
+    async function sampleShots(stateOffset) {
+        const numQubits = state.grid[0].length;
+        const qubits = share_state.shotQubits ?? [...Array(numQubits).keys()];
+        const qubitMask = qubits.filter(q => q < numQubits).reduce((mask, q) => mask | (1 << q), 0);
+        const measured = qubitMask.toString(2).split('1').length - 1;
+        const flags = Number(resultState.shared.boolView[0] & BigInt(0x70)); // 単精度・SoA・クラスタのビット
+        const seed = Math.floor(Math.random() * 0x100000000);
+
+        const words = await requestCommand(COMMAND_SAMPLE, [stateOffset, numQubits, flags, qubitMask, share_state.shots, seed]);
+        const counts = new Int32Array(memory.buffer, words[0], 1 << measured);
+        showShotHistogram(counts, measured, share_state.shots, shareState);
+    }
+
+    /**
+     * 計算済みの状態ベクトルから量子ビット対の縮約密度行列と concurrence・purity を求める
+     * 
+     * 対象は share_state.metricPairs（[[a, b], ...]、先頭 MAX_METRIC_PAIRS 件）で、
+     * 結果は share_state.result.pairMetrics に保存します。
+     * 
+     * @param {number} stateOffset - 状態ベクトルのオフセット
+     */
+    async function measurePairs(stateOffset) {
+        const numQubits = state.grid[0].length;
+        const pairs = share_state.metricPairs
+            .filter(([a, b]) => a !== b && Math.max(a, b) < numQubits)
+            .slice(0, MAX_METRIC_PAIRS);
+        const flags = Number(resultState.shared.boolView[0] & BigInt(0x70)); // 単精度・SoA・クラスタのビット
+
+        // 引数：状態ベクトル, キュービット数, 形式フラグ, 対の数, 対（2ワードずつ）
+        const words = await requestCommand(COMMAND_PAIRS, [stateOffset, numQubits, flags, pairs.length, ...pairs.flat()]);
+        const metrics = new Float64Array(memory.buffer, words[0], pairs.length * PAIR_METRIC_SIZE);
+        share_state['result'].pairMetrics = pairs.map((pair, k) => {
+            const metric = metrics.subarray(k * PAIR_METRIC_SIZE, (k + 1) * PAIR_METRIC_SIZE);
+            return {
+                qubits: pair,
+                densityMatrix: Array.from(metric.subarray(0, 32)), // 4×4複素行列（実部・虚部交互、行優先）
+                concurrence: metric[32],
+                purity: metric[33]
+            };
+        });
+        console.log("量子ビット対の指標:", share_state['result'].pairMetrics);
+    }
+
+    /**
+     * 1つのスライダー（初期状態パラメータ）を複数の値に変えた各キュービットの密度行列をまとめて求める
+     * 
+     * 対象は share_state.sweep（{parameter: 初期状態パラメータ配列内の位置（2q = Theta, 2q+1 = Phi）, values: [度, ...]}）で、
+     * 直前の計算と同じ回路・他のスライダー値を使います。回路の実行は値の数によらず2回のため、
+     * スライダーのアニメーションの各フレームを事前に求められます。
+     * 結果は share_state.result.sweep に保存します。
+     * 
+     * @param {Array} arenaOffsets - 直前の計算の引数オフセット（初期状態パラメータ・演算リスト・状態ベクトルの位置に使用）
+     */
+    async function sweepSlider(arenaOffsets) {
+        const numQubits = state.grid[0].length;
+        const { parameter, values } = share_state.sweep;
+        share_state.sweep = null;
+        if (!(parameter >= 0 && parameter < 2 * numQubits) || !values?.length) {
+            return;
+        }
+
+        // エンジンが確保した入力値の領域に値を書き込んでから掃引を実行
+        const [valuesOffset] = await requestCommand(COMMAND_SWEEP_VALUES, [values.length]);
+        new Float64Array(memory.buffer, valuesOffset, values.length).set(values);
+        // 状態ベクトルの領域は掃引の作業領域として上書きされる（最終結果の処理の最後に実行）
+        const flags = Number(resultState.shared.boolView[0] & BigInt(0x30)); // 単精度・SoAのビット
+        const words = await requestCommand(COMMAND_SWEEP, [arenaOffsets[0], numQubits, arenaOffsets[12], parameter, valuesOffset, values.length, arenaOffsets[8], flags]);
+        if (words[0] === 0) {
+            console.error('Error in slider sweep:', 'failed to allocate the work vector');
+            share_state['result'].sweep = null;
+            return;
+        }
+        const densityMatrices = new Float64Array(memory.buffer, words[0], values.length * numQubits * 8);
+        share_state['result'].sweep = {
+            parameter: parameter,
+            values: Array.from(values),
+            // 値ごとの密度行列（sumDoubleArray の densityMatrix と同じ8要素×キュービット数）
+            densityMatrices: values.map((value, v) => densityMatrices.slice(v * numQubits * 8, (v + 1) * numQubits * 8))
+        };
+        console.log("スライダーの掃引:", share_state['result'].sweep);
+    }
+
+    /**
      * メインスレッドでのアニメーション関数
      * リアルタイムで量子計算の更新をチェックし、必要に応じてWASM計算を実行
      */
     async function animate() {
         const dateTime = performance.now();
 
-        // WASM 計算処理が必要なタイミングで Web Worker にメッセージを送信
+        // WASM 計算処理が必要なタイミングで Web Worker に計算を指示
         // 条件：処理中でない かつ 更新が必要 かつ 前回から十分時間が経過
         if (!isProcessingWasm && share_state.updateResult && share_state.endDateTime < dateTime - 100) {
             share_state.updateResult = false;
             isProcessingWasm = true;
 
-            // 回路データを準備してWASMに送信するためのオフセット取得
-            const offsets = loadAndRunWasm(state, shareState, sharedBuffer, JSON.parse(JSON.stringify(constOffsets)), JSON.parse(JSON.stringify(constOffset)));
-
-            console.log("start calculetion")
-            let startTime = performance.now();
-
-            // Web Workerに計算実行メッセージを送信
-            worker.postMessage({types: 'invoke', sharedBuffer: sharedBuffer, memory: null, offsets: offsets});
-
-            // Web Worker から計算結果を受け取る処理
-            worker.onmessage = async function (event) {
-                const endTime = performance.now();
-                const elapsedTime = endTime - startTime;
-                console.log("演算時間:", elapsedTime, "ミリ秒");
-                
-                if (event.data.success) {
-                    console.log('WASM calculation completed successfully.');
-                    returnResult(state, shareState); // 結果をUIに反映
-                    
-                    // 継続計算が必要かチェック（ビット7が0の場合）
-                    if (!((resultState.shared.boolView[0] >> BigInt(7)) & BigInt(1))){
-                        // フレームレート調整のための待機時間計算
-                        const endTime = performance.now();
-                        const waitTime = Math.max(
-                            (share_state.oneStepTime / share_state.cutintValue) - (endTime - startTime),
-                            0
-                        );
-                        await new Promise((resolve) => setTimeout(resolve, waitTime));
-                        startTime = performance.now();
-                        // 次の計算ステップを実行
-                        worker.postMessage({types: 'invoke', sharedBuffer: sharedBuffer, memory: null, offsets: offsets});
+            // 回路に合わせて領域を確保し、回路データを書き込んでオフセットを取得
+            offsets = null;
+            const arenaOffsets = await loadAndRunWasm(state, shareState, memory, requestLayout);
+            if (arenaOffsets) {
+                offsets = arenaOffsets;
+                console.log("start calculetion")
+                invokeWorker();
+            } else {
+                console.error('Error in WASM calculation:', 'failed to allocate the state vector');
+                isProcessingWasm = false;
+            }
+        }
+
+        // 継続計算の次のステップ（待機時間の経過後に実行、回路が更新された場合は中断）
+        if (nextStepTime !== null && dateTime >= nextStepTime) {
+            nextStepTime = null;
+            if (share_state.updateResult) {
+                isProcessingWasm = false;
+            } else {
+                invokeWorker();
+            }
+        }
+
+        // 計算完了の確認（Workerが加算する世代番号を直接読む）
+        const completed = Atomics.load(control, CONTROL_GENERATION);
+        if (isProcessingWasm && offsets !== null && nextStepTime === null && completed !== generation) {
+            generation = completed;
+            console.log("演算時間:", performance.now() - startTime, "ミリ秒");
+
+            // 時間予算で中断した場合（ビット8）は結果を反映せず、次のフレームで続きを実行
+            if ((resultState.shared.boolView[0] >> BigInt(8)) & BigInt(1)){
+                nextStepTime = performance.now();
+            } else {
+                returnResult(state, shareState); // 結果をUIに反映
+                if (share_state.counters) {
+                    console.log("フェーズ別カウンタ:", readPhaseCounters());
+                }
+
+                // 継続計算が必要かチェック（ビット7が0の場合）
+                if (!((resultState.shared.boolView[0] >> BigInt(7)) & BigInt(1))){
+                    // フレームレート調整のための待機時間計算
+                    const waitTime = Math.max(
+                        (share_state.oneStepTime / share_state.cutintValue) - (performance.now() - startTime),
+                        0
+                    );
+                    nextStepTime = performance.now() + waitTime;
+                } else if (share_state.shots > 0 || share_state.metricPairs?.length || share_state.sweep) {
+                    // 最終結果から測定サンプリング・量子ビット対の指標・スライダーの掃引を計算（完了まで次の計算を開始しない）
+                    const arenaOffsets = offsets;
+                    offsets = null;
+                    if (share_state.shots > 0) {
+                        await sampleShots(arenaOffsets[8]);
+                    }
+                    if (share_state.metricPairs?.length) {
+                        await measurePairs(arenaOffsets[8]);
+                    }
+                    if (share_state.sweep) {
+                        await sweepSlider(arenaOffsets);
                     }
+                    isProcessingWasm = false;
                 } else {
-                    console.error('Error in WASM calculation:', event.data.error);
+                    isProcessingWasm = false;
                 }
-                
+
                 share_state.endDateTime = performance.now();  // タイムスタンプを更新
-                isProcessingWasm = false;
                 console.log("最終演算時間:",share_state.endDateTime-startTime,"ms")
-            };
+            }
         }
 
         // 次のフレームをリクエスト（60FPS目標）
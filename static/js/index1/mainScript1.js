@@ -191,7 +191,16 @@ function initialSetting(){
                 'target': {qtips: qtips, resultCoordinates: resultCoordinates}, 
                 'result': {qtips: qtips, resultCoordinates: resultCoordinates}, 
                 convertGate: convertGate, 
-                maxQubit: 21
+                maxQubit: 21,
+                precision: 'double',        // 状態ベクトルの精度（'double' / 'single'）
+                layout: 'interleaved',      // 状態ベクトルのレイアウト（'interleaved' / 'split'）
+                stateMode: 'dense',         // 状態の保持方法（'dense' / 'cluster'）
+                timeBudget: 0,              // 1回の計算呼び出しの時間予算（ミリ秒、0で無制限）
+                counters: false,            // フェーズ別カウンタをコンソールに出力
+                shots: 0,                   // 測定サンプリングの回数（0でサンプリングなし）
+                shotQubits: null,           // 測定するキュービット番号の配列（nullで全キュービット）
+                metricPairs: null,          // concurrence・purity を求めるキュービット対 [[a, b], ...]（最大6対）
+                sweep: null                 // スライダーの掃引 {parameter: 初期状態パラメータの位置, values: [度, ...]}
             },
             processor: drawCanvas1,
             bar: {
@@ -8,18 +8,98 @@
  * WebAssembly Worker - 量子回路計算用ワーカー
  * 
  * 機能:
- * - WebAssemblyモジュールの初期化と実行
+ * - WebAssemblyモジュールの初期化と実行（メインスレッドでコンパイル済みのモジュールを受け取る）
  * - 量子状態計算の並列処理
  * - メインスレッドとの非同期通信
  * - SharedArrayBufferを使用したメモリ共有
+ * - 制御ブロック（Atomics）による常駐計算ループ
  */
 
-let sumDoubleArray = null; // WASM関数をグローバル変数として定義
+// 制御ブロック（Int32Array）のワード位置（funcqcal.js と共通）
+const CONTROL_COMMAND = 0;      // コマンドワード
+const CONTROL_GENERATION = 1;   // 完了した計算の世代番号
+const CONTROL_OFFSETS = 2;      // sumDoubleArray の引数オフセット（16ワード）
+const CONTROL_LENGTH = CONTROL_OFFSETS + 16;
+const COMMAND_IDLE = 0;         // 待機中
+const COMMAND_RUN = 1;          // sumDoubleArray を1回実行
+const COMMAND_LAYOUT = 2;       // 引数オフセットのワードのバイト長で layoutArena を実行
+const COMMAND_SAMPLE = 3;       // 引数オフセットのワードの引数で sampleMeasurements を実行
+const COMMAND_PAIRS = 4;        // 引数オフセットのワードの引数で calculatePairMetrics を実行
+const COMMAND_SWEEP_VALUES = 5; // 引数オフセットの先頭のワードの値の数で reserveSweepValues を実行
+const COMMAND_SWEEP = 6;        // 引数オフセットのワードの引数で sweepInitialParameter を実行
+
+let sumDoubleArray = null;   // WASM関数をグローバル変数として定義
+let setPhaseCounters = null; // フェーズ別カウンタの登録関数
+let layoutArena = null;      // 計算領域（アリーナ）の確保関数
+let sampleMeasurements = null; // 測定サンプリング関数
+let calculatePairMetrics = null; // 量子ビット対の指標の計算関数
+let reserveSweepValues = null;   // パラメータ掃引の入力値の領域の確保関数
+let sweepInitialParameter = null; // パラメータ掃引の計算関数
+
+/**
+ * 常駐計算ループ
+ *
+ * コマンドワードが COMMAND_RUN になるまで待機し、制御ブロックのオフセットで
+ * sumDoubleArray を実行します。COMMAND_LAYOUT では同じワードに書かれたバイト長で
+ * 計算領域を確保し、各領域の先頭オフセットを書き戻します。COMMAND_SAMPLE（測定サンプリング）と
+ * COMMAND_PAIRS（量子ビット対の指標）、COMMAND_SWEEP_VALUES / COMMAND_SWEEP（初期状態パラメータの掃引）では、
+ * 結果の配列のオフセットを先頭のワードに書き戻します。完了すると世代番号を加算して通知するため、
+ * メインスレッドはメッセージを介さずに requestAnimationFrame から完了を確認できます。
+ * Atomics.waitAsync が使える場合はイベントループを止めずに待機します
+ * （pthreadワーカーからのプロキシ呼び出しを処理するため）。
+ *
+ * @param {Int32Array} control - 制御ブロック
+ */
+async function computeLoop(control) {
+    while (true) {
+        const command = Atomics.load(control, CONTROL_COMMAND);
+        if (command === COMMAND_IDLE) {
+            if (Atomics.waitAsync) {
+                await Atomics.waitAsync(control, CONTROL_COMMAND, COMMAND_IDLE).value;
+            } else {
+                Atomics.wait(control, CONTROL_COMMAND, COMMAND_IDLE);
+            }
+            continue;
+        }
+
+        try {
+            if (command === COMMAND_LAYOUT) {
+                // 計算領域の確保（オフセットのワードをその場で書き換え）
+                layoutArena(control.byteOffset + CONTROL_OFFSETS * Int32Array.BYTES_PER_ELEMENT, CONTROL_LENGTH - CONTROL_OFFSETS);
+            } else if (command === COMMAND_SAMPLE) {
+                // 測定サンプリング（状態ベクトル, キュービット数, 形式フラグ, 測定マスク, 測定回数, 乱数の種）
+                control[CONTROL_OFFSETS] = sampleMeasurements(...control.subarray(CONTROL_OFFSETS, CONTROL_OFFSETS + 6));
+            } else if (command === COMMAND_PAIRS) {
+                // 量子ビット対の指標（状態ベクトル, キュービット数, 形式フラグ, 対の数, 対は5ワード目以降）
+                const [state, numQubits, flags, pairCount] = control.subarray(CONTROL_OFFSETS, CONTROL_OFFSETS + 4);
+                const pairs = control.byteOffset + (CONTROL_OFFSETS + 4) * Int32Array.BYTES_PER_ELEMENT;
+                control[CONTROL_OFFSETS] = calculatePairMetrics(state, numQubits, flags, pairs, pairCount);
+            } else if (command === COMMAND_SWEEP_VALUES) {
+                // パラメータ掃引の入力値の領域（値の数）
+                control[CONTROL_OFFSETS] = reserveSweepValues(control[CONTROL_OFFSETS]);
+            } else if (command === COMMAND_SWEEP) {
+                // パラメータ掃引（初期状態パラメータ, キュービット数, 演算リスト, パラメータ位置, 入力値, 値の数,
+                //               作業に使う状態ベクトル, 形式フラグ）
+                control[CONTROL_OFFSETS] = sweepInitialParameter(...control.subarray(CONTROL_OFFSETS, CONTROL_OFFSETS + 8));
+            } else {
+                // WASM関数の実行
+                sumDoubleArray(...control.subarray(CONTROL_OFFSETS, CONTROL_LENGTH));
+            }
+        } catch (error) {
+            self.postMessage({ success: false, error: error.message });
+        }
+
+        // 完了を通知（世代番号の更新までに書き込んだ共有メモリはメインスレッドから見える）
+        Atomics.store(control, CONTROL_COMMAND, COMMAND_IDLE);
+        Atomics.add(control, CONTROL_GENERATION, 1);
+        Atomics.notify(control, CONTROL_GENERATION);
+    }
+}
 
 
 // Web Workerのメッセージハンドラー
 onmessage = async function (event) {
-    const { types, sharedBuffer, memory, offsets } = event.data;
+    const { types, sharedBuffer, memory, offsets, engine } = event.data;
     // console.log("types:",types)
     // console.log("sharedBuffer:",sharedBuffer)
     // console.log("memory:",memory)
@@ -27,137 +107,49 @@ onmessage = async function (event) {
 
     if (types === 'initialize') {
         // WebAssembly初期化処理
-
-        // WASI (WebAssembly System Interface) のモックオブジェクト
-        const wasiSnapshotPreview1 = {
-            fd_write: (fd, iov, iovcnt, pOut) => {
-                console.log(`fd_write called with fd=${fd}, iov=${iov}, iovcnt=${iovcnt}, pOut=${pOut}`);
-                return 0;
-            },
-            fd_read: (fd, iov, iovcnt, pOut) => {
-                console.log(`fd_read called with fd=${fd}, iov=${iov}, iovcnt=${iovcnt}, pOut=${pOut}`);
-                return 0;
-            },
-            fd_seek: (fd, offset_low, offset_high, whence, newOffset) => {
-                console.log(`fd_seek called with fd=${fd}, offset_low=${offset_low}, offset_high=${offset_high}, whence=${whence}`);
-                return 0;
-            },
-            fd_close: (fd) => {
-                console.log("fd_close called");
-                return 0;
-            },
-        };
-
-        // Emscripten環境関数のモックオブジェクト
-        const env = {
-            // 非同期スリープ関数（デバッグ用）
-            emscripten_sleep: (value) => {
-                console.log("Value from WASM: " + value);
-            },
-            // 現在時刻取得
-            emscripten_get_now: () => performance.now(),
-            // インラインアセンブリ呼び出し
-            emscripten_asm_const_int: (code) => {
-                console.log("emscripten_asm_const_int called with code:", code);
-                return 0; // ダミーの戻り値
-            },
-            // ヒープサイズ変更
-            emscripten_resize_heap: (size) => {
-                console.warn(`emscripten_resize_heap called with size: ${size}`);
-                return true;
-            },
-            // アサーション失敗処理
-            __assert_fail: (condition, file, line, func) => {
-                console.error(`Assertion failed: condition=${condition}, file=${file}, line=${line}, func=${func}`);
-            },
-            // C++例外処理
-            __cxa_throw: (ptr, type, destructor) => {
-                console.error(`C++ exception thrown with ptr=${ptr}, type=${type}, destructor=${destructor}`);
-            },
-            // スレッド間メールボックス通知
-            _emscripten_notify_mailbox_postmessage: () => {
-                console.log('_emscripten_notify_mailbox_postmessage called');
-            },
-            // プロセス終了
-            exit: (status) => {
-                console.log(`exit called with status: ${status}`);
-            },
-            // スレッドクリーンアップ
-            _emscripten_thread_cleanup: () => {
-                console.log('_emscripten_thread_cleanup called');
-            },
-            // 異常終了処理
-            _abort_js: (message) => {
-                console.error(`_abort_js called with message: ${message}`);
-            },
-            // ランタイム終了
-            emscripten_exit_with_live_runtime: () => {
-                console.log('emscripten_exit_with_live_runtime called');
-            },
-            // スレッド強参照設定
-            _emscripten_thread_set_strongref: (thread) => {
-                console.log(`_emscripten_thread_set_strongref called for thread: ${thread}`);
-            },
-            // スレッドメールボックス待機
-            _emscripten_thread_mailbox_await: (thread) => {
-                console.log(`_emscripten_thread_mailbox_await called for thread: ${thread}`);
-            },
-            // メインスレッド初期化
-            _emscripten_init_main_thread_js: (args) => {
-                console.log(`_emscripten_init_main_thread_js called with args: ${args}`);
-            },
-            // メインスレッド通信
-            _emscripten_receive_on_main_thread_js: (func, data) => {
-                console.log(`_emscripten_receive_on_main_thread_js called with func: ${func}, data: ${data}`);
-            },
-            // ブロッキング許可チェック
-            emscripten_check_blocking_allowed: () => {
-                console.log('emscripten_check_blocking_allowed called');
-                return 1;
-            },
-        };
-
         try {
-            // WebAssemblyインポートオブジェクトの構築
-            const importObject = {
-                wasi_snapshot_preview1: wasiSnapshotPreview1,
-                env: env,
-            };
+            // Emscriptenグルーコード（MODULARIZE出力、グローバル関数 Module を定義）の読み込み
+            // engine.script はメインスレッドが選んだ通常版・SIMD128版の内容ハッシュ付きURL
+            importScripts(engine.script);
 
-            // SharedArrayBufferメモリの設定
-            importObject.env.memory = memory;
+            // メインスレッドで確保した共有メモリとコンパイル済みモジュールを渡して初期化
+            // （WASMファイルの取得・コンパイルを省略。pthreadビルドではグルーコードが同じモジュールと
+            //   共有WebAssembly.Memoryをスレッドプールの各ワーカーに配布するため、再コンパイルしない）
+            const qcal = await Module({
+                wasmMemory: memory,                          // SharedArrayBufferメモリ
+                mainScriptUrlOrBlob: engine.script,          // pthreadワーカーが読み込むスクリプト
+                locateFile: (path) => '/static/cpp/' + path, // グルーコードが参照するファイルの配置場所
+                instantiateWasm: (imports, receiveInstance) => {
+                    WebAssembly.instantiate(engine.module, imports)
+                        .then((instance) => receiveInstance(instance, engine.module))
+                        .catch((error) => self.postMessage({ success: false, error: error.message }));
+                    return {}; // インスタンス化は非同期（exports は receiveInstance で設定）
+                },
+            });
 
-            // WASM呼び出しの処理を進める
-            const wasmBytes = await fetch('/static/cpp/qcal.wasm').then(res => res.arrayBuffer());
-            const { instance } = await WebAssembly.instantiate(wasmBytes, importObject);
-            
             // WASM関数をグローバル変数に保存
-            sumDoubleArray = instance.exports.sumDoubleArray;
+            sumDoubleArray = qcal._sumDoubleArray;
+            setPhaseCounters = qcal._setPhaseCounters;
+            layoutArena = qcal._layoutArena;
+            sampleMeasurements = qcal._sampleMeasurements;
+            calculatePairMetrics = qcal._calculatePairMetrics;
+            reserveSweepValues = qcal._reserveSweepValues;
+            sweepInitialParameter = qcal._sweepInitialParameter;
 
-            // 結果をメインスレッドに送信
-            self.postMessage({ success: true });
-        } catch (error) {
-            self.postMessage({ success: false, error: error.message });
-        }
-    } else if (types === 'invoke') {
-        // 次回以降のWASM関数呼び出し処理
-        // console.log(new Int32Array(sharedBuffer));
-
-        try {
-            // 量子状態計算のサンプルコード（コメントアウト済み）
-            // let state_vector = new Array(2**22).fill(0);
-            // let densityMatrix = new Array(8*21).fill(0);
-            // state_vector[0]=1;
-            // for (let i=0;i<21;i++){
-            //     state_vector = apply_controlled_gate(state_vector, 21);
-            // }
-            // calculateTraceState( state_vector, 21, densityMatrix)
+            // 論理コア数に合わせて計算スレッド数を設定
+            qcal._setThreadCount(navigator.hardwareConcurrency || 1);
 
-            // WASM関数の実行
-            sumDoubleArray(...offsets);
-            self.postMessage({ success: true });
+            // 結果をメインスレッドに送信（エンジンの静的領域にある制御ブロック・カウンタの位置を含む）
+            self.postMessage({
+                success: true,
+                offsets: { control: qcal._workerControlBlock(), counters: qcal._phaseCounterBlock() }
+            });
         } catch (error) {
             self.postMessage({ success: false, error: error.message });
         }
+    } else if (types === 'listen') {
+        // 常駐計算ループを開始（offsets = [制御ブロック, フェーズ別カウンタ] のバイトオフセット）
+        setPhaseCounters(offsets[1]);
+        computeLoop(new Int32Array(sharedBuffer, offsets[0], CONTROL_LENGTH));
     }
 };